@@ -5,6 +5,7 @@
 #include <cstring>
 
 #include "base64.hpp"
+#include "cpu.hpp"
 
 namespace {
     // All allowed base 64 characters
@@ -24,6 +25,40 @@ namespace {
 /*! Base64 encode
  */
 void steg::base64_encode(const char* const value, const std::size_t size, char* out)
+{
+    // Resolved on first use
+    static void (* const impl)(const char* const, const std::size_t, char*) = [] {
+#if defined(STEG_X86)
+        if (cpu_supports(CPU_AVX2)) {
+            return &base64_encode_avx2;
+        }
+#endif
+        return &base64_encode_scalar;
+    }();
+
+    impl(value, size, out);
+}
+
+/*! Base64 in-place decode
+ */
+std::size_t steg::base64_decode(char* const value, const std::size_t size)
+{
+    // Resolved on first use
+    static std::size_t (* const impl)(char* const, const std::size_t) = [] {
+#if defined(STEG_X86)
+        if (cpu_supports(CPU_AVX2)) {
+            return &base64_decode_avx2;
+        }
+#endif
+        return &base64_decode_scalar;
+    }();
+
+    return impl(value, size);
+}
+
+/*! Base64 encode, one octet at a time
+ */
+void steg::base64_encode_scalar(const char* const value, const std::size_t size, char* out)
 {
     // Temp. reusable container for the three chars (octets) that are encoded to a four byte array
     char octets[3] = {  };
@@ -76,9 +111,9 @@ void steg::base64_encode(const char* const value, const std::size_t size, char*
     *out++ = base64chars[indices[3]];
 }
 
-/*! Base64 in-place decode
+/*! Base64 in-place decode, one hexet at a time
  */
-std::size_t steg::base64_decode(char* const value, const std::size_t size)
+std::size_t steg::base64_decode_scalar(char* const value, const std::size_t size)
 {
     // Temp. reusable container for the four bytes (hexets) that are decoded to three octets
     char hexets[4] = {  };
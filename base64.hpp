@@ -16,6 +16,15 @@ namespace steg {
     /// @param size     data size [in]
     /// @return         number of bytes decoded
     std::size_t base64_decode(char* const value, const std::size_t size);
+
+    /// Portable implementations
+    void base64_encode_scalar(const char* const value, const std::size_t size, char* output);
+    std::size_t base64_decode_scalar(char* const value, const std::size_t size);
+
+    /// AVX2 implementations, 32 base64 characters per step; x86 only, must only be called if cpu_supports() the extension
+    /// Same output as the portable ones for any input that the encoder produces
+    void base64_encode_avx2(const char* const value, const std::size_t size, char* output);
+    std::size_t base64_decode_avx2(char* const value, const std::size_t size);
 }
 
 #endif
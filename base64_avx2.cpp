@@ -0,0 +1,130 @@
+/* base64_avx2.cpp -- v1.0 -- base64 encoding & decoding using AVX2
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstring>
+
+#include "base64.hpp"
+#include "cpu.hpp"
+
+#if defined(STEG_X86)
+
+// Everything below is built for AVX2, and only runs if the host supports it (see base64_encode)
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+namespace {
+    /*! Maps 32 hexets (0-63) to their base64 characters
+     */
+    inline __m256i to_chars(const __m256i hexets)
+    {
+        // Offset from a hexet to its character, by range:
+        // 0-25 'A', 26-51 'a', 52-61 '0', 62 '+', 63 '/'
+        const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                 '/' - 63, 'A', 0, 0,
+                                                 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                 '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                                 '/' - 63, 'A', 0, 0);
+
+        // Range index: 0 for 26-51, 1-12 for 52-63, 13 for 0-25
+        __m256i range = _mm256_subs_epu8(hexets, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), hexets), _mm256_set1_epi8(13)));
+
+        return _mm256_add_epi8(hexets, _mm256_shuffle_epi8(offsets, range));
+    }
+
+    /*! Maps 32 base64 characters to their hexets
+     * @return    false if any of them is not a base64 character
+     */
+    inline bool to_hexets(const __m256i chars, __m256i& hexets)
+    {
+        // Valid characters, by low and high nibble
+        const __m256i lo_lut = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+                                                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+        const __m256i hi_lut = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        // Offset from a character to its hexet, by high nibble ('/' gets its own)
+        const __m256i roll_lut = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                                  0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibble);
+        const __m256i lo = _mm256_and_si256(chars, nibble);
+
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(lo_lut, lo), _mm256_shuffle_epi8(hi_lut, hi))) {
+            return false;
+        }
+
+        const __m256i slash = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('/'));
+        hexets = _mm256_add_epi8(chars, _mm256_shuffle_epi8(roll_lut, _mm256_add_epi8(slash, hi)));
+
+        return true;
+    }
+}
+
+/*! Base64 encode, 24 octets per step
+ */
+void steg::base64_encode_avx2(const char* const value, const std::size_t size, char* out)
+{
+    std::size_t i = 0;
+
+    // Each 128-bit lane takes 12 octets; the second load reads 4 bytes past them
+    for ( ; (i + 28) <= size; i += 24, out += 32)
+    {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(value + i))),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(value + i + 12)), 1);
+
+        // Spread each group of three octets over 32 bits, then cut out the four hexets
+        in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+
+        const __m256i a = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        const __m256i b = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), to_chars(_mm256_or_si256(a, b)));
+    }
+
+    // Trailing octets
+    base64_encode_scalar(value + i, size - i, out);
+}
+
+/*! Base64 in-place decode, 32 hexets per step
+ */
+std::size_t steg::base64_decode_avx2(char* const value, const std::size_t size)
+{
+    char* ptr = value;
+
+    std::size_t i = 0;
+    for ( ; (i + 32) <= size; i += 32, ptr += 24)
+    {
+        __m256i hexets;
+        if (!to_hexets(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(value + i)), hexets)) {
+            break; // Leave the rest to the portable decoder
+        }
+
+        // Merge hexet pairs into 12 bits, then pairs of those into 24 bits
+        const __m256i pairs = _mm256_maddubs_epi16(hexets, _mm256_set1_epi32(0x01400140));
+        const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+
+        // Pack the three octets of each 32-bit word, big-endian, into the low 12 bytes of each lane
+        const __m256i octets = _mm256_shuffle_epi8(words, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        // Output trails input, so this never overwrites characters not yet decoded
+        const __m256i packed = _mm256_permutevar8x32_epi32(octets, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(ptr + 16), _mm256_extracti128_si256(packed, 1));
+    }
+
+    // Trailing hexets; move them up to the output first
+    ::memmove(ptr, value + i, size - i);
+    return static_cast<std::size_t>(ptr - value) + base64_decode_scalar(ptr, size - i);
+}
+
+#endif
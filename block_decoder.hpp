@@ -4,7 +4,12 @@
 #ifndef _BLOCK_DECODER_HPP
 #define _BLOCK_DECODER_HPP
 
+#include <cstring>
+
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
 #include "decoder.hpp"
+#include "error.hpp"
 
 namespace steg {
     //! @class block_decoder
@@ -16,7 +21,9 @@ namespace steg {
         /// Factory method, returns a block_decoder
         /// @param key       AES key string
         /// @param initvec   initialization vector string
-        inline static block_decoder* create(const char* const key, const char* const initvec);
+        /// @param mode      block cipher mode the message was encrypted with
+        /// @param nonce     nonce recorded in the message's header, or nullptr if it has none; see cipher_init()
+        inline static block_decoder* create(const char* const key, const char* const initvec, const cipher::mode_type mode, const char* const nonce);
 
         /// Decodes input message and writes to output
         /// @param inp       input stream
@@ -26,6 +33,9 @@ namespace steg {
                   typename Tout>
         inline bool run(Tinp& inp, Tout& out);
 
+        /// Spreads decryption over a pool of threads, in CTR and ECB modes
+        using decoder::set_pool;
+
     private:
 
         /*! Helper
@@ -35,13 +45,8 @@ namespace steg {
         inline bool decode_digest(Tout& out,
                                   char* const buff,
                                   typename std::enable_if<!vvb64, std::size_t>::type size) {
-            // Decodes from digest to raw data
-            bool ret;
-            if ((ret = decoder::decode(buff, size))) {
-                ret = out.write(buff, size); // Pipe to output
-            }
-
-            return ret;
+            // Decodes from digest to raw data, and pipes it to output
+            return decode_message(out, buff, size);
         }
 
         /*! Generates a digest from the message and encodes it base64
@@ -52,17 +57,43 @@ namespace steg {
                                   char* const buff,
                                   typename std::enable_if<vvb64, std::size_t>::type base64Size) {
 
+            // Count the trailing '=' padding, which decodes to no bytes
+            std::size_t padding = 0;
+            while (padding != 2 && padding != base64Size && buff[base64Size - padding - 1] == '=') {
+                ++padding;
+            }
+
             // Decode digest from base64
-            std::size_t size = base64_decode(buff, base64Size);
-            size = size - (size % decoder::get()->length);
+            std::size_t size = base64_decode(buff, base64Size) - padding;
 
             // Decode raw data from digest
-            bool ret;
-            if ((ret = decoder::decode(buff, size))) {
-                ret = out.write(buff, size);
+            return decode_message(out, buff, size);
+        }
+
+        /*! Helper
+         * Decrypts the message and pipes it to output; in GCM mode, gives up after the check block if
+         * the key does not match, and only pipes the message once its tag is verified
+         */
+        template <typename Tout>
+        inline bool decode_message(Tout& out, char* buff, std::size_t size) {
+            if ((decoder::get())->mode != cipher::GCM) {
+                size = size - (size % decoder::get()->length);
+                return decoder::decode(buff, size) && out.write(buff, size);
             }
 
-            return ret;
+            const char zeros[cipher_check_size] = {  };
+            if (size < cipher_check_size + cipher_tag_size ||
+                !decoder::decode(buff, cipher_check_size) ||
+                ::memcmp(buff, zeros, cipher_check_size) != 0) {
+                return ((error::get())->log("Error: wrong key or initialization vector, or no message in the image, exiting"), false);
+            }
+
+            buff += cipher_check_size;
+            size -= cipher_check_size + cipher_tag_size;
+
+            return decoder::decode(buff, size) &&
+                   decoder::verify(buff + size, cipher_tag_size) &&
+                   out.write(buff, size);
         }
 
         /*! ctor. Private, use factory method create() instead
@@ -73,14 +104,18 @@ namespace steg {
     /// Factory method, returns block decoder
     /// @param key        AES key string
     /// @param initvec    initialization vector string
+    /// @param mode       block cipher mode
+    /// @param nonce      message nonce, or nullptr
     template <bool b64,
               typename Talloc>
     block_decoder<b64, Talloc>* block_decoder<b64, Talloc>::create(const char* const key,
-                                                                   const char* const initvec)
+                                                                   const char* const initvec,
+                                                                   const cipher::mode_type mode,
+                                                                   const char* const nonce)
     {
         // Use gcrypt to initialize cipher before passing it to the decoder
         cipher* cph;
-        if ((cph = cipher_init(key, initvec)) == nullptr)
+        if ((cph = cipher_init(key, initvec, mode, nonce)) == nullptr)
             return nullptr;
         return new block_decoder(std::move(cph));
     }
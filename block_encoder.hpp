@@ -4,9 +4,10 @@
 #ifndef _BLOCK_ENCODER_HPP
 #define _BLOCK_ENCODER_HPP
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <utility>
-#include <type_traits>
 
 #include "base64.hpp"
 #include "cipher.hpp"
@@ -14,6 +15,7 @@
 
 #include "decoder.hpp"
 #include "encoder.hpp"
+#include "thread_pool.hpp"
 
 namespace steg {
     // @class
@@ -25,12 +27,24 @@ namespace steg {
         /// Factory method, returns a block_encoder
         /// @param key        AES key string
         /// @param initvec    initialization vector string
-        inline static block_encoder* create(const char* const key, const char* const initvec);
+        /// @param mode       block cipher mode
+        /// @param nonce      the message's nonce, or nullptr if it has none; see cipher_init()
+        inline static block_encoder* create(const char* const key, const char* const initvec, const cipher::mode_type mode, const char* const nonce);
 
         /// @dtor.
-        block_encoder() : encoder(nullptr) {  }
+        block_encoder() : encoder(nullptr), nchunks_(1) {  }
+
+        /// Spreads encryption over a pool of threads, in CTR and ECB modes; a chunk, and a slice,
+        /// per thread are read and encrypted at a time
+        /// @param pool    worker threads, or nullptr to run on the calling thread only
+        inline void set_pool(thread_pool* pool) {
+            encoder::set_pool(pool);
+            nchunks_ = (pool != nullptr) ? pool->size() : 1;
+        }
 
-        /// Encrypts input message and writes resulting image to output
+        /// Encrypts input message and writes resulting image to output; the message is read a chunk at
+        /// a time, and each slice of a chunk is embedded as soon as it is encrypted. ECB pads the last
+        /// chunk, CTR and GCM do not pad the message
         /// @param inp    input stream
         /// @param out    output stream
         /// @return       boolean flag indicating success or failure
@@ -38,83 +52,54 @@ namespace steg {
                   typename Tout>
         inline bool run(Tinp& inp, Tout& out);
 
-    private:
-
-        /*! Helper
-         * Padds the buffer size to a multiple of the digest length
-         */
-        inline std::size_t calc_digest_size(std::size_t size) const {
+        /// Size of the output for a message, without encoding it
+        /// @param size    message size
+        /// @param mode    block cipher mode
+        /// @return        output size
+        inline static std::size_t encoded_size(const std::size_t size, const cipher::mode_type mode);
 
-            std::size_t mod;
-            if ((mod = (size % (encoder::get())->length)) == 0) {
-                return size;
-            }
+        /// Largest message whose output fits
+        /// @param capacity    room for the output
+        /// @param mode        block cipher mode
+        /// @return            message size
+        inline static std::size_t max_message_size(const std::size_t capacity, const cipher::mode_type mode);
 
-            else {
-                return (size + (encoder::get()->length - mod));
-            }
-        }
+    private:
 
-        /* Helper
-         * Generates a digest from the message
-         */
-        template <typename Tout,
-                  bool vvb64 = b64>
-        inline bool encode_digest(Tout& out,
-                                  char* const buff,
-                                  typename std::enable_if<!vvb64, std::size_t>::type size) {
-
-            // Encode raw data to digest
-            if (encoder::encode(buff, size))
-            {
-                // Pipe to output and return 
-                if (out.write(buff, size)) {
-                    return true;
-                }
-            }
+        // Message bytes read at a time, per thread
+        static const std::size_t chunk_size = 3 * 256 * 1024;
 
-            return false;
-        }
+        // Bytes encrypted and embedded at a time, per thread, small enough to stay in cache in between;
+        // a multiple of 3, so that the base64 encoding of each slice joins the next one without padding,
+        // and of the ECB digest length
+        static const std::size_t slice_size = 3 * 32 * 1024;
 
         /* Helper
-         * Generates a digest from the message and encodes the result to base64
+         * Appends an encrypted slice of the message to the output, base64 encoded if b64
          */
-        template <typename Tout,
-                  bool vvb64 = b64>
-        inline bool encode_digest(Tout& out,
-                                  char* const buff,
-                                  typename std::enable_if<vvb64, std::size_t>::type size) {
-            // Encode raw data to digest
-            if (!encoder::encode(buff, size)) {
-                return false;
-            }
-
-            // Encode digest to base64...
-            // Calculate base64 size
-            std::size_t b64size;
-
-            if (size % 3) {
-                b64size = (size + 3 - (size % 3)) * 4/3;
+        template <typename Tout>
+        inline bool append_slice(Tout& out, const char* const buff, const std::size_t size, char* const b64buff) {
+            if (!b64) {
+                return out.append(buff, size) == size;
             }
 
-            else {
-                b64size = size * 4/3;
-            }
-
-            // Encode to base64
-            char* const b64buff = Talloc::allocate(b64size);
+            // Only the last slice may be padded; mark the padding with '=', so that an unpadded
+            // (CTR or GCM) message decodes to its own length; ECB output is left as older versions write it
+            const std::size_t b64size = ((size + 2) / 3) * 4;
             base64_encode(buff, size, b64buff);
+            for (std::size_t i = size; (i % 3) && (encoder::get())->mode != cipher::ECB; ++i) {
+                b64buff[b64size - 3 + (i % 3)] = '=';
+            }
 
-            // Pipe to output
-            out.write(b64buff, b64size);
-
-            // Cleanup & return
-            return (Talloc::deallocate(b64buff), true);
+            return out.append(b64buff, b64size) == b64size;
         }
 
         /*! ctor. Private, use factory method create() instead
          */
-        inline explicit block_encoder(cipher*&& cph) : encoder(cph) {  }
+        inline explicit block_encoder(cipher*&& cph) : encoder(cph), nchunks_(1) {  }
+
+        // No. of chunks read and encrypted at a time
+        std::size_t nchunks_;
     };
 
     /*! Factory method
@@ -122,15 +107,44 @@ namespace steg {
     template <bool b64,
               typename Talloc>
     block_encoder<b64, Talloc>* block_encoder<b64, Talloc>::create(const char* const key,
-                                                                   const char* const initvec)
+                                                                   const char* const initvec,
+                                                                   const cipher::mode_type mode,
+                                                                   const char* const nonce)
     {
         // Use gcrypt to initialize cipher before passing it to the encoder
         cipher* cph;
-        if ((cph = cipher_init(key, initvec)) == nullptr)
+        if ((cph = cipher_init(key, initvec, mode, nonce)) == nullptr)
             return nullptr;
         return new block_encoder(std::move(cph));
     }
 
+    /*! Output size
+     */
+    template <bool b64,
+              typename Talloc>
+    std::size_t block_encoder<b64, Talloc>::encoded_size(const std::size_t size, const cipher::mode_type mode)
+    {
+        // Padded to a multiple of the digest length, plus the mode's overhead, then 4 base64
+        // characters per 3 bytes, rounded up
+        const std::size_t length = cipher_length(mode);
+        const std::size_t padded = (((size + length - 1) / length) * length) + cipher_overhead(mode);
+
+        return b64 ? (((padded + 2) / 3) * 4) : padded;
+    }
+
+    /*! Largest message
+     */
+    template <bool b64,
+              typename Talloc>
+    std::size_t block_encoder<b64, Talloc>::max_message_size(const std::size_t capacity, const cipher::mode_type mode)
+    {
+        const std::size_t length = cipher_length(mode);
+        const std::size_t overhead = cipher_overhead(mode);
+        const std::size_t padded = b64 ? ((capacity / 4) * 3) : capacity;
+
+        return (padded > overhead) ? (((padded - overhead) / length) * length) : 0;
+    }
+
     /*! Encrypts input message and writes resulting image to output
      */
     template <bool b64,
@@ -139,24 +153,69 @@ namespace steg {
               typename Tout>
     bool block_encoder<b64, Talloc>::run(Tinp& inp, Tout& out)
     {
-        // Input read size
-        std::size_t inpSize = inp.size();
-        if (inpSize == 0) {
-            inpSize = 100000; // Default size for unknown size input
+        // A chunk at a time, the message size need not be known
+        const cipher::mode_type mode = (encoder::get())->mode;
+        const std::size_t length = (encoder::get())->length;
+
+        // Leaves room for ECB padding, or the tag, after the last chunk
+        const std::size_t chunk = chunk_size * nchunks_;
+        const std::size_t slice = slice_size * nchunks_;
+        char* const buff = Talloc::allocate(chunk + length + cipher_tag_size);
+        char* const b64buff = b64 ? Talloc::allocate(((slice + cipher_tag_size + 2) / 3) * 4) : nullptr;
+
+        // In GCM mode, the first chunk starts with the check block, a block of zeros
+        std::size_t offset = 0;
+        if (mode == cipher::GCM) {
+            ::memset(buff, 0, cipher_check_size);
+            offset = cipher_check_size;
         }
 
-        // padded to a multiple of the block size
-        char* const buff = Talloc::allocate(calc_digest_size(inpSize) + 1);
+        bool ret = true;
+        std::size_t total = 0;
+
+        while (ret)
+        {
+            const std::size_t size = inp.read(buff + offset, chunk - offset);
+            total += size;
 
-        // Run...
-        bool ret = false;
+            // End of input
+            const bool last = (size != chunk - offset);
 
-        std::size_t size;
-        if ((size = inp.read(buff, inpSize)) != 0) {
-            ret = encode_digest(out, buff, calc_digest_size(size));
+            // ECB pads the message with zeros to a multiple of the digest length
+            std::size_t n = offset + size;
+            if (last && (n % length) != 0) {
+                ::memset(buff + n, 0, length - (n % length));
+                n += length - (n % length);
+            }
+
+            // Embeds each slice right after encrypting it, while it is still in cache
+            std::size_t i = 0;
+            do {
+                const std::size_t m = std::min(slice, n - i);
+                ret = encoder::encode(buff + i, m);
+
+                // In GCM mode, the tag follows the last slice
+                std::size_t k = m;
+                if (ret && last && (i + m) == n && mode == cipher::GCM) {
+                    ret = encoder::tag(buff + n, cipher_tag_size);
+                    k += cipher_tag_size;
+                }
+
+                ret = ret && append_slice(out, buff + i, k, b64buff);
+                i += m;
+            } while (ret && i != n);
+
+            offset = 0;
+
+            if (last) {
+                break;
+            }
         }
 
+        ret = ret && (total != 0) && out.finish();
+
         // Clean up & return
+        Talloc::deallocate(b64buff);
         return (Talloc::deallocate(buff), ret);
     }
 }
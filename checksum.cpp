@@ -0,0 +1,85 @@
+/* checksum.cpp -- v1.0 -- CRC-32C checksum, used to validate the message stored in an image
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "checksum.hpp"
+#include "cpu.hpp"
+
+namespace {
+    /*! @class: slicing-by-8 lookup tables for the reflected polynomial 0x82f63b78
+     */
+    struct crc_table {
+
+        std::uint32_t values[8][256];
+
+        inline crc_table() {
+
+            for (std::uint32_t i = 0; i != 256; ++i)
+            {
+                std::uint32_t crc = i;
+                for (int j = 0; j != 8; ++j) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+                }
+
+                values[0][i] = crc;
+            }
+
+            for (std::uint32_t i = 0; i != 256; ++i) {
+                for (int j = 1; j != 8; ++j) {
+                    values[j][i] = (values[j - 1][i] >> 8) ^ values[0][values[j - 1][i] & 0xff];
+                }
+            }
+        }
+    };
+
+    // Generated once, on first use
+    const crc_table& table() {
+        static const crc_table tbl;
+        return tbl;
+    }
+}
+
+/*! CRC-32C
+ */
+std::uint32_t steg::crc32c(std::uint32_t crc, const char* const data, const std::size_t size)
+{
+    // Resolved on first use
+    static std::uint32_t (* const impl)(std::uint32_t, const char* const, const std::size_t) = [] {
+#if defined(STEG_X86)
+        if (cpu_supports(CPU_SSE42)) {
+            return &crc32c_sse42;
+        }
+#endif
+        return &crc32c_scalar;
+    }();
+
+    return impl(crc, data, size);
+}
+
+/*! CRC-32C, eight bytes per step
+ */
+std::uint32_t steg::crc32c_scalar(std::uint32_t crc, const char* const data, const std::size_t size)
+{
+    const std::uint32_t (&t)[8][256] = table().values;
+    const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* const end = ptr + size;
+
+    crc = ~crc;
+
+    for ( ; (end - ptr) >= 8; ptr += 8)
+    {
+        const std::uint32_t lo = crc ^ (ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | (static_cast<std::uint32_t>(ptr[3]) << 24));
+
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][ptr[4]] ^ t[2][ptr[5]] ^ t[1][ptr[6]] ^ t[0][ptr[7]];
+    }
+
+    // Trailing bytes
+    for ( ; ptr != end; ++ptr) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *ptr) & 0xff];
+    }
+
+    return ~crc;
+}
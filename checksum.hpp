@@ -0,0 +1,24 @@
+/* checksum.hpp -- v1.0 -- CRC-32C checksum, used to validate the message stored in an image
+   Author: Sam Y. 2021 */
+
+#ifndef _CHECKSUM_HPP
+#define _CHECKSUM_HPP
+
+#include <cstdint>
+
+namespace steg {
+    /// Computes the CRC-32C (Castagnoli) checksum of a buffer, with the fastest implementation the host supports
+    /// @param crc     checksum of the preceding data, 0 to start
+    /// @param data    input buffer [in]
+    /// @param size    size of input buffer
+    /// @return        updated checksum
+    std::uint32_t crc32c(std::uint32_t crc, const char* const data, const std::size_t size);
+
+    /// Portable implementation, slicing-by-8
+    std::uint32_t crc32c_scalar(std::uint32_t crc, const char* const data, const std::size_t size);
+
+    /// SSE4.2 implementation, x86 only; must only be called if cpu_supports() the extension
+    std::uint32_t crc32c_sse42(std::uint32_t crc, const char* const data, const std::size_t size);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/* checksum_sse42.cpp -- v1.0 -- CRC-32C checksum using the SSE4.2 crc32 instruction
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "checksum.hpp"
+#include "cpu.hpp"
+
+#if defined(STEG_X86)
+
+// Everything below is built for SSE4.2, and only runs if the host supports it (see crc32c)
+#pragma GCC target("sse4.2")
+
+#include <nmmintrin.h>
+
+/*! CRC-32C, eight bytes per instruction
+ */
+std::uint32_t steg::crc32c_sse42(std::uint32_t crc, const char* const data, const std::size_t size)
+{
+    const unsigned char* ptr = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* const end = ptr + size;
+
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    std::uint64_t crc64 = crc;
+    for ( ; (end - ptr) >= 8; ptr += 8)
+    {
+        std::uint64_t word;
+        ::memcpy(&word, ptr, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+#endif
+
+    for ( ; (end - ptr) >= 4; ptr += 4)
+    {
+        std::uint32_t word;
+        ::memcpy(&word, ptr, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+
+    // Trailing bytes
+    for ( ; ptr != end; ++ptr) {
+        crc = _mm_crc32_u8(crc, *ptr);
+    }
+
+    return ~crc;
+}
+
+#endif
@@ -4,13 +4,37 @@
 #ifndef _CIPHER_HPP
 #define _CIPHER_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace steg {
     /// @class cipher
     struct cipher {
+
+        /// Block cipher mode
+        enum mode_type { ECB, CTR, GCM };
+
         // Handle to cipher
         void* hd;
-        // Digest length
+        // Digest length; messages are padded to a multiple of it
         std::size_t length;
+        // Block cipher mode
+        mode_type mode;
+
+        // Key and initialization vector (the initial counter block, in CTR mode; derived from the message's nonce, in CTR and GCM modes), for the handles of other threads
+        char key[16];
+        char initvec[16];
+
+        // Fingerprint of the key and mode, under which the handles are cached
+        std::string fingerprint;
+
+        // Bytes encrypted or decrypted so far
+        std::uint64_t offset;
+
+        // Handles of other threads, opened on first use
+        std::vector<void*> workers;
     };
 }
 
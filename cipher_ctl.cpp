@@ -1,62 +1,361 @@
 /* cipher_ctl.cpp -- v1.0 -- used for libgcrypt cipher generation and clean up
    Author: Sam Y. 2021 */
 
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include <gcrypt.h>
 
 #include "cipher.hpp"
 #include "cipher_ctl.hpp"
 #include "error.hpp"
+#include "thread_pool.hpp"
 
 namespace {
+    // Fewest bytes a thread encrypts or decrypts at a time; smaller ranges are not worth handing out
+    const std::size_t min_range = 64 * 1024;
+
+    // Most idle handles the cache keeps, across keys
+    const std::size_t max_idle = 64;
+
     // Helper
     inline void log(const int ret) {
         (steg::error::get())->log("Error: ", gcry_strsource(ret), ", ", gcry_strerror(ret));
     }
+
+    /*! @class handle_cache
+     * Idle handles, keyed by a fingerprint of their key and mode; their key schedule is kept, so a handle
+     * taken from the cache only needs a new IV or counter. Safe to share across threads
+     */
+    class handle_cache {
+    public:
+
+        ~handle_cache() {
+            for (auto& entry : idle_) {
+                for (gcry_cipher_hd_t hd : entry.second) {
+                    gcry_cipher_close(hd);
+                }
+            }
+        }
+
+        handle_cache() : size_(0) {  }
+
+        /*! Takes an idle handle for the fingerprint, or returns nullptr if there is none
+         */
+        gcry_cipher_hd_t take(const std::string& fingerprint) {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = idle_.find(fingerprint);
+            if (it == idle_.end() || it->second.empty()) {
+                return nullptr;
+            }
+
+            gcry_cipher_hd_t hd = it->second.back();
+            it->second.pop_back();
+            --size_;
+
+            return hd;
+        }
+
+        /*! Gives a handle back, or closes it if the cache is full
+         */
+        void give(const std::string& fingerprint, gcry_cipher_hd_t hd) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (size_ != max_idle) {
+                    idle_[fingerprint].push_back(hd);
+                    ++size_;
+                    return;
+                }
+            }
+
+            gcry_cipher_close(hd);
+        }
+
+    private:
+
+        std::mutex mutex_;
+        std::unordered_map<std::string, std::vector<gcry_cipher_hd_t>> idle_;
+        std::size_t size_; // > no. of idle handles
+    };
+
+    /*! Helper
+     * The process-wide cache
+     */
+    inline handle_cache& cache() {
+        static handle_cache instance;
+        return instance;
+    }
+
+    /*! Helper
+     * SHA-256 over a label, the mode and the key bytes the cipher uses; handles are only
+     * cached by fingerprint, never by the key itself
+     */
+    std::string fingerprint(const char* const key, const steg::cipher::mode_type mode)
+    {
+        const std::size_t keylen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
+        const char label[] = "steg cipher";
+
+        std::vector<char> input(sizeof(label) + 1 + keylen);
+        ::memcpy(input.data(), label, sizeof(label));
+        input[sizeof(label)] = static_cast<char>(mode);
+        ::memcpy(input.data() + sizeof(label) + 1, key, keylen);
+
+        char digest[32];
+        gcry_md_hash_buffer(GCRY_MD_SHA256, digest, input.data(), input.size());
+
+        return std::string(digest, sizeof(digest));
+    }
+
+    /*! Helper
+     * SHA-256 over a label, the key bytes the cipher uses, the initialization vector and the nonce,
+     * truncated to a block; a counter that no other message starts from, under the same key
+     */
+    void derive(char* const out, const char* const key, const char* const initv, const char* const nonce)
+    {
+        const std::size_t keylen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
+        const std::size_t blklen = gcry_cipher_get_algo_blklen(GCRY_CIPHER_AES128);
+        const char label[] = "steg counter";
+
+        std::vector<char> input(sizeof(label) + keylen + blklen + steg::cipher_nonce_size);
+        char* pos = input.data();
+        ::memcpy(pos, label, sizeof(label));
+        ::memcpy(pos += sizeof(label), key, keylen);
+        ::memcpy(pos += keylen, initv, blklen);
+        ::memcpy(pos += blklen, nonce, steg::cipher_nonce_size);
+
+        char digest[32];
+        gcry_md_hash_buffer(GCRY_MD_SHA256, digest, input.data(), input.size());
+
+        ::memcpy(out, digest, blklen);
+    }
+
+    /*! Helper
+     * Takes a handle from the cache, or opens one and sets its key; then sets its initialization
+     * vector, which in CTR mode is the first counter block (GCM derives its own from the IV)
+     */
+    gcry_error_t open(gcry_cipher_hd_t& hd, const std::string& fp, const char* const key, const char* const initv, const steg::cipher::mode_type mode)
+    {
+        const std::size_t keylen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
+        const std::size_t blklen = gcry_cipher_get_algo_blklen(GCRY_CIPHER_AES128);
+
+        const int gcrymode = (mode == steg::cipher::GCM) ? GCRY_CIPHER_MODE_GCM :
+                             (mode == steg::cipher::CTR) ? GCRY_CIPHER_MODE_CTR : GCRY_CIPHER_MODE_ECB;
+
+        gcry_error_t ret;
+
+        // Keyed already; clears what the last job left, the IV, counter and tag
+        if ((hd = cache().take(fp)) != nullptr) {
+            ret = gcry_cipher_reset(hd);
+        }
+
+        else if ((ret = gcry_cipher_open(&hd, GCRY_CIPHER_AES128, gcrymode, 0)) != 0) {
+            return ret;
+        }
+
+        else {
+            ret = gcry_cipher_setkey(hd, key, keylen);
+        }
+
+        if (ret != 0 ||
+            (ret = ((mode == steg::cipher::CTR) ? gcry_cipher_setctr(hd, initv, blklen) : gcry_cipher_setiv(hd, initv, blklen))) != 0) {
+            gcry_cipher_close(hd);
+        }
+
+        return ret;
+    }
+
+    /*! Helper
+     * Points a CTR handle at the given block of the message: its counter is the initialization
+     * vector plus the block's index, as a 128-bit big-endian integer
+     */
+    gcry_error_t seek(gcry_cipher_hd_t hd, const char* const initv, std::uint64_t block)
+    {
+        unsigned char ctr[16];
+        ::memcpy(ctr, initv, sizeof(ctr));
+
+        for (int i = sizeof(ctr) - 1; i >= 0 && block != 0; --i)
+        {
+            const unsigned int sum = ctr[i] + static_cast<unsigned int>(block & 0xff);
+            ctr[i] = static_cast<unsigned char>(sum);
+            block = (block >> 8) + (sum >> 8);
+        }
+
+        return gcry_cipher_setctr(hd, ctr, sizeof(ctr));
+    }
+
+    /*! Helper
+     * Encrypts or decrypts in place
+     */
+    inline gcry_error_t crypt(gcry_cipher_hd_t hd, const bool encrypt, char* const data, const std::size_t size) {
+        return encrypt ? gcry_cipher_encrypt(hd, data, size, nullptr, 0) : gcry_cipher_decrypt(hd, data, size, nullptr, 0);
+    }
 }
 
 /*! Initializes cipher
  */
-struct steg::cipher* steg::cipher_init(const char* const key, const char* const initv)
+struct steg::cipher* steg::cipher_init(const char* const key, const char* const initv, const cipher::mode_type mode, const char* const nonce)
 {
+    const std::string fp = fingerprint(key, mode);
     gcry_cipher_hd_t hd;
-    const std::size_t keylen = gcry_cipher_get_algo_blklen(GCRY_CIPHER_AES128);
-    const std::size_t blklen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
 
-    // Create a handle for algorithm ALGO to be used in MODE.  FLAGS may
-    // be given as an bitwise OR of the gcry_cipher_flags values.
-    int ret;
-    if ((ret = gcry_cipher_open(&hd, GCRY_CIPHER_AES128, GCRY_CIPHER_MODE_ECB, 0)) != 0) {
-        return (log(ret), nullptr);
+    // In CTR and GCM modes, each message starts from a counter (or IV) of its own, so that none share a
+    // keystream, nor, in GCM mode, give away the authentication key by reusing an IV
+    char counter[16];
+    const char* start = initv;
+
+    if (nonce != nullptr && mode != cipher::ECB) {
+        derive(counter, key, initv, nonce);
+        start = counter;
     }
 
-    // Retrieve the key length in bytes used with algorithm A.
-    // Set KEY of length KEYLEN bytes for the cipher handle HD.
-    if ((ret = gcry_cipher_setkey(hd, key, keylen)) != 0)
-    {
-        gcry_cipher_close(hd);
+    gcry_error_t ret;
+    if ((ret = open(hd, fp, key, start, mode)) != 0) {
         return (log(ret), nullptr);
     }
 
-    // Retrieve the block length in bytes used with algorithm A.
-    // Set initialization vector IV of length IVLEN for the cipher handle HD.
-    if ((ret = gcry_cipher_setiv(hd, initv, blklen)) != 0)
+    // Allocate and return; the key and IV are kept for the handles of other threads
+    cipher* const cph = new cipher();
+    cph->hd = hd;
+    cph->fingerprint = fp;
+    cph->length = cipher_length(mode);
+    cph->mode = mode;
+    ::memcpy(cph->key, key, sizeof(cph->key));
+    ::memcpy(cph->initvec, start, sizeof(cph->initvec));
+    cph->offset = 0;
+
+    return cph;
+}
+
+/*! Encrypts or decrypts data in-place, across threads
+ */
+unsigned int steg::cipher_crypt(cipher& cph, const bool encrypt, char* const data, const std::size_t size, thread_pool* pool)
+{
+    const std::size_t blklen = gcry_cipher_get_algo_blklen(GCRY_CIPHER_AES128);
+    gcry_cipher_hd_t hd = reinterpret_cast<gcry_cipher_hd_t>(cph.hd);
+
+    // One range of whole blocks per thread; GCM authenticates the message as a whole, and
+    // a counter that stopped mid-block cannot be handed out
+    const std::size_t ntasks = (pool == nullptr || cph.mode == cipher::GCM || (cph.offset % blklen) != 0) ?
+                               1 : std::min<std::size_t>(pool->size(), size / min_range);
+
+    if (ntasks < 2) {
+        cph.offset += size;
+        return crypt(hd, encrypt, data, size);
+    }
+
+    // Take the handles of other threads on first use
+    while (cph.workers.size() < ntasks - 1)
     {
-        gcry_cipher_close(hd);
-        return (log(ret), nullptr);
+        gcry_cipher_hd_t whd;
+
+        gcry_error_t ret;
+        if ((ret = open(whd, cph.fingerprint, cph.key, cph.initvec, cph.mode)) != 0) {
+            return ret;
+        }
+
+        cph.workers.push_back(whd);
+    }
+
+    const std::size_t nblocks = size / blklen;
+    const std::uint64_t first = cph.offset / blklen;
+
+    // The calling thread's handle takes the first range
+    std::vector<gcry_error_t> rets(ntasks, 0);
+
+    pool->run(ntasks, [&](const std::size_t i) {
+        gcry_cipher_hd_t thd = (i == 0) ? hd : reinterpret_cast<gcry_cipher_hd_t>(cph.workers[i - 1]);
+
+        const std::size_t b0 = (nblocks * i) / ntasks;
+        const std::size_t b1 = (nblocks * (i + 1)) / ntasks;
+
+        if (cph.mode == cipher::CTR && (rets[i] = seek(thd, cph.initvec, first + b0)) != 0) {
+            return;
+        }
+
+        rets[i] = crypt(thd, encrypt, data + (b0 * blklen), (b1 - b0) * blklen);
+    });
+
+    for (const gcry_error_t ret : rets) {
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    // The calling thread's handle picks up after the last block, and takes what is left of a partial one
+    cph.offset += size;
+
+    gcry_error_t ret = 0;
+    if (cph.mode == cipher::CTR) {
+        ret = seek(hd, cph.initvec, first + nblocks);
+    }
+
+    const std::size_t done = nblocks * blklen;
+    if (ret == 0 && done != size) {
+        ret = crypt(hd, encrypt, data + done, size - done);
     }
 
-    // Allocate and return
-    return new cipher({
-            hd,
-            128 // AES 128
-        });
+    return ret;
 }
 
-/*! Closes cipher and deallocates memory
+/*! Generates a nonce
+ */
+void steg::cipher_nonce(char* const out)
+{
+    gcry_create_nonce(out, cipher_nonce_size);
+}
+
+/*! Digest length
+ */
+std::size_t steg::cipher_length(const cipher::mode_type mode)
+{
+    return (mode == cipher::ECB) ? 128 : 1; // CTR and GCM need no padding; AES 128
+}
+
+/*! Message overhead
+ */
+std::size_t steg::cipher_overhead(const cipher::mode_type mode)
+{
+    return (mode == cipher::GCM) ? (cipher_check_size + cipher_tag_size) : 0;
+}
+
+/*! Gives the cipher's handles back to the cache
  */
 void steg::cipher_close(steg::cipher& cph)
 {
-    gcry_cipher_hd_t hd = reinterpret_cast<gcry_cipher_hd_t>(cph.hd);
-    gcry_cipher_close(hd);
+    cache().give(cph.fingerprint, reinterpret_cast<gcry_cipher_hd_t>(cph.hd));
+
+    for (void* const whd : cph.workers) {
+        cache().give(cph.fingerprint, reinterpret_cast<gcry_cipher_hd_t>(whd));
+    }
+    cph.workers.clear();
 }
 
+
+/*! Derives a seed from a key
+ */
+std::uint64_t steg::cipher_seed(const char* const key, const char* const label)
+{
+    // SHA-256 over the label, its terminating null, and the key bytes the cipher uses
+    const std::size_t keylen = gcry_cipher_get_algo_keylen(GCRY_CIPHER_AES128);
+    const std::size_t lablen = ::strlen(label) + 1;
+
+    std::vector<char> input(lablen + keylen);
+    ::memcpy(input.data(), label, lablen);
+    ::memcpy(input.data() + lablen, key, keylen);
+
+    unsigned char digest[32];
+    gcry_md_hash_buffer(GCRY_MD_SHA256, digest, input.data(), input.size());
+
+    std::uint64_t seed = 0;
+    for (int i = 0; i != 8; ++i) {
+        seed = (seed << 8) | digest[i];
+    }
+
+    return seed;
+}
@@ -4,19 +4,68 @@
 #ifndef _CIPHER_CTL_HPP
 #define _CIPHER_CTL_HPP
 
+#include <cstddef>
+#include <cstdint>
+
+#include "cipher.hpp"
+
 namespace steg {
     // Fwd. decl.
-    struct cipher;
+    class thread_pool;
+
+    // In GCM mode, a message is preceded by an encrypted block of zeros, which tells a wrong key
+    // from the right one after one block, and followed by its authentication tag
+    const std::size_t cipher_check_size = 16;
+    const std::size_t cipher_tag_size = 16;
 
-    /// Closes cipher and deallocates memory
+    // A message's nonce, recorded in its header; makes the starting counter unique to the message
+    const std::size_t cipher_nonce_size = 16;
+
+    /// Closes cipher; its handles go back to the cache, and keep their key schedule
     /// @param cipher    class
     void cipher_close(cipher& cipher);
 
-    /// Factory method, used for cipher initialization
+    /// Factory method, used for cipher initialization; takes a handle already keyed with
+    /// key from a cache shared by all threads, if there is one, and only sets its IV
     /// @param key        AES key string
-    /// @param initvec    initialization vector string
+    /// @param initvec    initialization vector string; the initial counter block in CTR mode
+    /// @param mode       ECB encrypts whole padded messages; CTR is a stream cipher, messages
+    ///                   of any size are encrypted a chunk at a time; GCM is CTR that also
+    ///                   authenticates the message
+    /// @param nonce      the message's nonce, cipher_nonce_size bytes; in CTR and GCM modes, the
+    ///                   initial counter block, or the IV, is derived from the key, initvec and
+    ///                   nonce. nullptr to start from initvec itself, for messages that have no nonce
     /// @return           on success, returns a non-null pointer to an initialized cipher
-    cipher* cipher_init(const char* const key, const char* const initvec);
+    cipher* cipher_init(const char* const key, const char* const initvec, const cipher::mode_type mode, const char* const nonce);
+
+    /// Generates a nonce for a new message
+    /// @param out    output buffer, cipher_nonce_size bytes [out]
+    void cipher_nonce(char* const out);
+
+    /// Encrypts or decrypts data in-place, from where the previous call left off; in CTR and ECB modes,
+    /// whole blocks are split into ranges, one per thread, each with a handle of its own (and, in CTR
+    /// mode, its counter pointed at the range), so the output does not depend on the no. of threads
+    /// @param cph        cipher
+    /// @param encrypt    encrypts (true), or decrypts (false)
+    /// @param data       input and output buffer
+    /// @param size       size of buffer
+    /// @param pool       worker threads, or nullptr to run on the calling thread only
+    /// @return           gcrypt error code, 0 on success
+    unsigned int cipher_crypt(cipher& cph, const bool encrypt, char* const data, const std::size_t size, thread_pool* pool);
+
+    /// @param mode    block cipher mode
+    /// @return        digest length of the ciphers cipher_init() returns; messages are padded to a multiple of it
+    std::size_t cipher_length(const cipher::mode_type mode);
+
+    /// @param mode    block cipher mode
+    /// @return        bytes the mode adds to a message: the check block and tag in GCM mode, none otherwise
+    std::size_t cipher_overhead(const cipher::mode_type mode);
+
+    /// Derives a 64-bit seed from an AES key, for uses other than encryption
+    /// @param key      AES key string
+    /// @param label    what the seed is used for; different labels give unrelated seeds
+    /// @return         seed
+    std::uint64_t cipher_seed(const char* const key, const char* const label);
 }
 
 #endif
@@ -0,0 +1,25 @@
+/* compression.hpp -- v1.0 -- describes how the image data of a PNG image is compressed
+   Author: Sam Y. 2021 */
+
+#ifndef _COMPRESSION_HPP
+#define _COMPRESSION_HPP
+
+namespace steg {
+    /// @class compression
+    struct compression {
+
+        /// Deflate implementation
+        enum backend {
+            STB,   // > stb_image_write's; needs the whole image in memory
+            ZLIB,  // > the system zlib, at the given level
+            STORE  // > stored blocks, rows unfiltered; fastest, largest files
+        };
+
+        // Deflate implementation
+        backend method;
+        // zlib compression level, 0 to 9
+        int level;
+    };
+}
+
+#endif
@@ -0,0 +1,69 @@
+/* cpu.cpp -- v1.0 -- detects the instruction set extensions of the host, used to pick kernels at runtime
+   Author: Sam Y. 2021 */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu.hpp"
+
+namespace {
+    /*! Helper
+     * Extensions the host supports
+     */
+    unsigned int detect()
+    {
+        unsigned int features = 0;
+
+#if defined(STEG_X86)
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("sse2")) {
+            features |= steg::CPU_SSE2;
+        }
+
+        if (__builtin_cpu_supports("sse4.2")) {
+            features |= steg::CPU_SSE42;
+        }
+
+        if (__builtin_cpu_supports("avx2")) {
+            features |= steg::CPU_AVX2;
+        }
+
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("bmi2")) {
+            features |= steg::CPU_AVX512;
+        }
+#endif
+
+        return features;
+    }
+
+    /*! Helper
+     * Extensions allowed by STEG_CPU, all of them if it is not set
+     */
+    unsigned int cap()
+    {
+        const char* const value = ::getenv("STEG_CPU");
+
+        if (value == nullptr) {
+            return ~0u;
+        }
+
+        // Each level includes the ones before it
+        const char* const names[] = { "scalar", "sse2", "sse4.2", "avx2", "avx512" };
+        for (unsigned int i = 0; i != (sizeof(names) / sizeof(names[0])); ++i) {
+            if (::strcmp(value, names[i]) == 0) {
+                return (1u << i) - 1;
+            }
+        }
+
+        return ~0u;
+    }
+}
+
+/*! Checks for an extension
+ */
+bool steg::cpu_supports(const cpu_feature feature)
+{
+    static const unsigned int features = detect() & cap();
+    return (features & feature) != 0;
+}
@@ -0,0 +1,29 @@
+/* cpu.hpp -- v1.0 -- detects the instruction set extensions of the host, used to pick kernels at runtime
+   Author: Sam Y. 2021 */
+
+#ifndef _CPU_HPP
+#define _CPU_HPP
+
+// Vector kernels are only built for x86; other targets use the portable ones
+#if defined(__x86_64__) || defined(__i386__)
+#define STEG_X86 1
+#endif
+
+namespace steg {
+    /// Instruction set extensions the kernels can use
+    enum cpu_feature {
+        CPU_SSE2   = 1 << 0,
+        CPU_SSE42  = 1 << 1,
+        CPU_AVX2   = 1 << 2,
+        CPU_AVX512 = 1 << 3  // > AVX-512F, AVX-512BW and BMI2
+    };
+
+    /// Checks whether the host supports an extension; detected once, on first use
+    /// The STEG_CPU environment variable caps the extensions used, one of
+    /// scalar, sse2, sse4.2, avx2 or avx512
+    /// @param feature    extension
+    /// @return           true if kernels may use it, false otherwise
+    bool cpu_supports(const cpu_feature feature);
+}
+
+#endif
@@ -25,9 +25,9 @@ steg::decoder::~decoder()
 bool steg::decoder::decode(char* const data, const std::size_t size)
 {
     cipher& cph = *cph_;
-    // Do an in-place decryption
+    // Do an in-place decryption, across threads if there is a pool
     std::size_t ret;
-    if ((ret = gcry_cipher_decrypt(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), data, size, nullptr, 0)) == 0) {
+    if ((ret = cipher_crypt(cph, false, data, size, pool_)) == 0) {
         return true;
     }
 
@@ -48,9 +48,31 @@ bool steg::decoder::decode(const char* const data,
     // Do an in-place decryption
     std::size_t ret;
     if ((ret = gcry_cipher_decrypt(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), out, outSize, data, size)) == 0) {
+        cph.offset += size;
+        return true;
+    }
+
+    const char* const strerror = gcry_strerror(ret);
+    const char* const strsource = gcry_strsource(ret);
+    // Report error
+    return ((error::get())->log("Error: ", strsource, ", ", strerror), false);
+}
+
+/*! Checks authentication tag
+ */
+bool steg::decoder::verify(const char* const tag, const std::size_t size)
+{
+    cipher& cph = *cph_;
+    std::size_t ret;
+    if ((ret = gcry_cipher_checktag(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), tag, size)) == 0) {
         return true;
     }
 
+    // A mismatch is the message's fault, not gcrypt's
+    if (gcry_err_code(ret) == GPG_ERR_CHECKSUM) {
+        return ((error::get())->log("Error: message failed authentication, image is corrupt or was altered, exiting"), false);
+    }
+
     const char* const strerror = gcry_strerror(ret);
     const char* const strsource = gcry_strsource(ret);
     // Report error
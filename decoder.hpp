@@ -7,6 +7,7 @@
 namespace steg {
     // Fwd. decl.
     struct cipher;
+    class thread_pool;
 
     /// @class    decoder
     /// base class
@@ -18,7 +19,13 @@ namespace steg {
 
         /// ctor.
         /// @param cph    the cipher implementation
-        inline explicit decoder(cipher* cph) : cph_(cph) {  }
+        inline explicit decoder(cipher* cph) : cph_(cph), pool_(nullptr) {  }
+
+        /// Spreads decryption over a pool of threads, in CTR and ECB modes
+        /// @param pool    worker threads, or nullptr to run on the calling thread only
+        inline void set_pool(thread_pool* pool) {
+            pool_ = pool;
+        }
 
         /// Decodes data in-place
         /// @param data    input buffer, padded to a multiple of the cipher block length
@@ -34,6 +41,12 @@ namespace steg {
         /// @return           true on succss, false otherwise
         bool decode(const char* const data, const std::size_t size, char* const out, const std::size_t outSize);
 
+        /// Checks the data decoded so far against its authentication tag, GCM mode only
+        /// @param tag     tag that follows the data [in]
+        /// @param size    size of tag, cipher_tag_size
+        /// @return        true if the data is authentic, false otherwise
+        bool verify(const char* const tag, const std::size_t size);
+
         /// @return    encapsulated cipher
         inline cipher* get() {
             return cph_;
@@ -47,6 +60,7 @@ namespace steg {
     private:
 
         cipher* cph_; // > the cipher implementation
+        thread_pool* pool_; // > worker threads, not owned; nullptr if single-threaded
     };
 }
 
@@ -23,9 +23,9 @@ steg::encoder::~encoder()
 bool steg::encoder::encode(char* const data, const std::size_t size)
 {
     cipher& cph = *cph_;
-    // Do an in-place encryption
+    // Do an in-place encryption, across threads if there is a pool
     std::size_t ret;
-    if ((ret = gcry_cipher_encrypt(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), data, size, nullptr, 0)) == 0) {
+    if ((ret = cipher_crypt(cph, true, data, size, pool_)) == 0) {
         return true;
     }
 
@@ -46,6 +46,23 @@ bool steg::encoder::encode(const char* const data,
     // Do an in-place encryption
     std::size_t ret;
     if ((ret = gcry_cipher_encrypt(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), out, outSize, data, size)) == 0) {
+        cph.offset += size;
+        return true;
+    }
+
+    const char* const strerror = gcry_strerror(ret);
+    const char* const strsource = gcry_strsource(ret);
+    // Report error
+    return ((error::get())->log("Error: ", strsource, ", ", strerror), false);
+}
+
+/*! Authentication tag
+ */
+bool steg::encoder::tag(char* const out, const std::size_t size)
+{
+    cipher& cph = *cph_;
+    std::size_t ret;
+    if ((ret = gcry_cipher_gettag(reinterpret_cast<gcry_cipher_hd_t>(cph.hd), out, size)) == 0) {
         return true;
     }
 
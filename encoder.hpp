@@ -7,6 +7,7 @@
 namespace steg {
     // Fwd. decl.
     struct cipher;
+    class thread_pool;
 
     /// @class: base
     class encoder {
@@ -17,7 +18,13 @@ namespace steg {
 
         /// ctor.
         /// @param cph    the cipher implementation
-        inline explicit encoder(cipher* cph) : cph_(cph) {  }
+        inline explicit encoder(cipher* cph) : cph_(cph), pool_(nullptr) {  }
+
+        /// Spreads encryption over a pool of threads, in CTR and ECB modes
+        /// @param pool    worker threads, or nullptr to run on the calling thread only
+        inline void set_pool(thread_pool* pool) {
+            pool_ = pool;
+        }
 
 
         /// Encodes data in-place
@@ -34,6 +41,12 @@ namespace steg {
         /// @return           true on succss, false otherwise
         bool encode(const char* const data, const std::size_t size, char* const out, const std::size_t outSize);
 
+        /// Authentication tag of the data encoded so far, GCM mode only
+        /// @param out     output buffer [out]
+        /// @param size    size of output buffer, cipher_tag_size
+        /// @return        true on succss, false otherwise
+        bool tag(char* const out, const std::size_t size);
+
         /// @return    encapsulated cipher
         inline cipher* get() {
             return cph_;
@@ -48,6 +61,9 @@ namespace steg {
 
         // The cipher implementation
         cipher* cph_;
+
+        // Worker threads, not owned; nullptr if single-threaded
+        thread_pool* pool_;
     };
 }
 
@@ -0,0 +1,80 @@
+/* header.cpp -- v1.0 -- header that precedes the message in an image
+   Author: Sam Y. 2021 */
+
+#include <cstring>
+
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
+#include "header.hpp"
+
+namespace {
+    // Identifies the header, and its version
+    const char magic[4] = { 's', 't', 'g', 0x02 };
+
+    // Version 1 headers do not record the cipher mode, nor a nonce
+    const char magic_v1[4] = { 's', 't', 'g', 0x01 };
+
+    /*! Helper
+     * Stores the nbytes low-order bytes of value, little-endian
+     */
+    inline void store(char* out, std::uint64_t value, const int nbytes) {
+        for (int i = 0; i != nbytes; ++i, value >>= 8) {
+            out[i] = static_cast<char>(value & 0xff);
+        }
+    }
+
+    /*! Helper
+     * Loads an nbytes little-endian integer
+     */
+    inline std::uint64_t load(const char* in, const int nbytes) {
+        std::uint64_t value = 0;
+        for (int i = nbytes; i != 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(in[i - 1]);
+        }
+        return value;
+    }
+}
+
+/*! Fills in a header
+ */
+void steg::header_store(char* out, const std::uint64_t length, const std::uint32_t checksum, const int mode, const char* nonce)
+{
+    ::memcpy(out, magic, sizeof(magic));
+    store(out + 4, length, 7);
+    store(out + 11, static_cast<std::uint64_t>(mode), 1);
+    store(out + 12, checksum, 4);
+    ::memcpy(out + 16, nonce, cipher_nonce_size);
+}
+
+/*! Parses a header
+ */
+bool steg::header_load(const char* in, std::uint64_t& length, std::uint32_t& checksum, int& mode, char* nonce, std::size_t& size)
+{
+    if (::memcmp(in, magic_v1, sizeof(magic_v1)) == 0)
+    {
+        length = load(in + 4, 8);
+        mode = -1;
+        ::memset(nonce, 0, cipher_nonce_size);
+        size = header_v1_size;
+    }
+
+    else if (::memcmp(in, magic, sizeof(magic)) == 0)
+    {
+        length = load(in + 4, 7);
+        mode = static_cast<int>(load(in + 11, 1));
+        ::memcpy(nonce, in + 16, cipher_nonce_size);
+        size = header_size;
+
+        if (mode > cipher::GCM) {
+            return false;
+        }
+    }
+
+    else {
+        return false;
+    }
+
+    checksum = static_cast<std::uint32_t>(load(in + 12, 4));
+
+    return true;
+}
@@ -0,0 +1,36 @@
+/* header.hpp -- v1.0 -- header that precedes the message in an image
+   Author: Sam Y. 2021 */
+
+#ifndef _HEADER_HPP
+#define _HEADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace steg {
+    // Header layout: magic and version, message size (56-bit), cipher mode (8-bit), message checksum
+    // (CRC-32C), message nonce (128-bit); integers are little-endian. Version 1 headers are 16 bytes,
+    // with a 64-bit size, and no cipher mode or nonce
+    const std::size_t header_size = 32;
+    const std::size_t header_v1_size = 16;
+
+    /// Fills in a header
+    /// @param out         output buffer, header_size bytes [out]
+    /// @param length      message size
+    /// @param checksum    message checksum
+    /// @param mode        cipher mode the message was encrypted with, a cipher::mode_type
+    /// @param nonce       message nonce, cipher_nonce_size bytes
+    void header_store(char* out, const std::uint64_t length, const std::uint32_t checksum, const int mode, const char* nonce);
+
+    /// Parses a header
+    /// @param in          input buffer, header_size bytes, or header_v1_size bytes followed by zeros [in]
+    /// @param length      message size [out]
+    /// @param checksum    message checksum [out]
+    /// @param mode        cipher mode, a cipher::mode_type; -1 for version 1 headers [out]
+    /// @param nonce       message nonce, cipher_nonce_size bytes; zeros for version 1 headers [out]
+    /// @param size        size of the header, header_size or header_v1_size [out]
+    /// @return            true if the buffer holds a header, false otherwise
+    bool header_load(const char* in, std::uint64_t& length, std::uint32_t& checksum, int& mode, char* nonce, std::size_t& size);
+}
+
+#endif
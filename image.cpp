@@ -2,12 +2,74 @@
    Author: Sam Y. 2021 */
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <utility>
 
 #include "stb.hpp"
 
+#include "checksum.hpp"
 #include "error.hpp"
+#include "header.hpp"
 #include "image.hpp"
+#include "lsb.hpp"
+#include "mapped_file.hpp"
+#include "raster.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+    // Bytes of image data per band; small enough to stay in a core's L2 cache
+    const std::size_t band_size = 256 * 1024;
+
+    /*! Helper
+     * Loads an image through the streaming readers, in a buffer stbi_image_free() releases
+     */
+    unsigned char* load(const char* path, int& w, int& h, int& nchanns, int& depth)
+    {
+        std::unique_ptr<steg::raster_reader> reader(steg::raster_reader::probe(path));
+        if (!reader) {
+            return nullptr;
+        }
+
+        w = reader->width();
+        h = reader->height();
+        nchanns = reader->channels();
+        depth = reader->depth();
+
+        const std::size_t size = static_cast<std::size_t>(w) * h * nchanns * depth;
+        unsigned char* const data = static_cast<unsigned char*>(STBI_MALLOC(size));
+
+        if (data == nullptr || !reader->read(data, h)) {
+            return (STBI_FREE(data), nullptr);
+        }
+
+        // Top row first, like stbi_load
+        if (reader->bottom_up())
+        {
+            const std::size_t rowSize = static_cast<std::size_t>(w) * nchanns * depth;
+            for (int r = 0; r != (h / 2); ++r) {
+                std::swap_ranges(data + (r * rowSize), data + ((r + 1) * rowSize), data + ((h - 1 - r) * rowSize));
+            }
+        }
+
+        return data;
+    }
+
+    /*! Helper
+     * Ensures the cells of an image can carry the bits per cell of a layout
+     */
+    bool check_bits(const steg::layout& lay, const int depth)
+    {
+        if (lay.bits > steg::max_bits(lay, depth)) {
+            return ((steg::error::get())->log("Error: bits per channel must be between 1 and 4 for 8-bit images, and 1 and 8 for 16-bit ones (7 with --legacy) (use -n), exiting"), false);
+        }
+
+        return true;
+    }
+}
 
 /*! dtor.
  */
@@ -23,7 +85,21 @@ steg::image::~image()
 steg::image::image() : data_(nullptr)
                      , w_(0)
                      , h_(0)
-                     , nchanns_(0) {  }
+                     , nchanns_(0)
+                     , depth_(1)
+                     , layout_({ 1, false, false, false, 0 })
+                     , ops_(nullptr)
+                     , length_(0)
+                     , checksum_(0)
+                     , cipher_(cipher::CTR)
+                     , mode_(-1)
+                     , nonce_()
+                     , recorded_()
+                     , embedded_(0)
+                     , crc_(0)
+                     , ncarry_(0)
+                     , pool_(nullptr)
+                     , compression_({ compression::STB, 6 }) {  }
 
 /*! ctor.
  */
@@ -31,7 +107,24 @@ steg::image::image(image&& other) : data_(other.data_)
                                   , w_(other.w_)
                                   , h_(other.h_)
                                   , nchanns_(other.nchanns_)
+                                  , depth_(other.depth_)
+                                  , layout_(other.layout_)
+                                  , ops_(other.ops_)
+                                  , scatter_(other.scatter_)
+                                  , length_(other.length_)
+                                  , checksum_(other.checksum_)
+                                  , cipher_(other.cipher_)
+                                  , mode_(other.mode_)
+                                  , embedded_(other.embedded_)
+                                  , crc_(other.crc_)
+                                  , ncarry_(other.ncarry_)
+                                  , pool_(other.pool_)
+                                  , compression_(other.compression_)
 {
+    ::memcpy(nonce_, other.nonce_, sizeof(nonce_));
+    ::memcpy(recorded_, other.recorded_, sizeof(recorded_));
+    ::memcpy(carry_, other.carry_, sizeof(carry_));
+
     other.data_ = nullptr;
     other.w_ = 0;
     other.h_ = 0;
@@ -46,6 +139,22 @@ steg::image& steg::image::operator=(image&& other)
     w_ = other.w_;
     h_ = other.h_;
     nchanns_ = other.nchanns_;
+    depth_ = other.depth_;
+    layout_ = other.layout_;
+    ops_ = other.ops_;
+    scatter_ = other.scatter_;
+    length_ = other.length_;
+    checksum_ = other.checksum_;
+    cipher_ = other.cipher_;
+    mode_ = other.mode_;
+    ::memcpy(nonce_, other.nonce_, sizeof(nonce_));
+    ::memcpy(recorded_, other.recorded_, sizeof(recorded_));
+    embedded_ = other.embedded_;
+    crc_ = other.crc_;
+    ::memcpy(carry_, other.carry_, sizeof(carry_));
+    ncarry_ = other.ncarry_;
+    pool_ = other.pool_;
+    compression_ = other.compression_;
 
     other.data_ = nullptr;
     other.w_ = 0;
@@ -55,12 +164,17 @@ steg::image& steg::image::operator=(image&& other)
     return *this;
 }
 
-/*! Image size
+/*! Message size
  */
 std::size_t steg::image::size() const
 {
-    // Width x Height x # channels
-    return w_ * h_ * nchanns_;
+    // Known from the header
+    if (length_ != 0) {
+        return length_;
+    }
+
+    // Otherwise, at most Width x Height x # channels
+    return static_cast<std::size_t>(w_) * h_ * nchanns_;
 }
 
 /*! Save file
@@ -72,10 +186,37 @@ bool steg::image::save(const char* path, const image_type type) const
         return ((error::get())->log("Error: invalid save path"), false);
     }
 
+    // stb only writes 8-bit samples
+    if (depth_ != 1 && type != PNG && type != PNM && type != PAM) {
+        return ((error::get())->log("Error: only PNG, PNM and PAM images can hold 16-bit samples, unable to save image ", path), false);
+    }
+
+    // A message spread over all channels only stays put if they do
+    if (layout_.allChanns && !keeps_channels(type, nchanns_)) {
+        return ((error::get())->log("Error: BMP and QOI images store grey pixels as RGB, which moves a message spread over all channels (-a); "
+                                    "use PNG, TGA, PNM or PAM, unable to save image ", path), false);
+    }
+
     switch (type)
     {
         case PNG:
         {
+            // zlib, through the streaming writer, which deflates bands of rows in parallel; stb cannot write 16-bit samples either
+            if (compression_.method != compression::STB || depth_ != 1)
+            {
+                std::unique_ptr<raster_writer> writer(raster_writer::create(path, type, w_, h_, nchanns_, depth_, false, compression_));
+                if (!writer) {
+                    return false;
+                }
+
+                writer->set_pool(pool_);
+                if (!(writer->write(data_, h_) && writer->close())) {
+                    return ((error::get())->log("Error: unable to save image ", path), false);
+                }
+
+                return true;
+            }
+
             const int stride = nchanns_ * w_;
             bool ret;
             if (!(ret = stbi_write_png(path, w_, h_, nchanns_, data_, stride)))
@@ -83,20 +224,30 @@ bool steg::image::save(const char* path, const image_type type) const
             return ret;
         }
 
-        case BMP:
+        case TGA:
         {
             bool ret;
-            if (!(ret = stbi_write_bmp(path, w_, h_, nchanns_, data_)))
+            if (!(ret = stbi_write_tga(path, w_, h_, nchanns_, data_)))
                 (error::get())->log("Error: unable to save image ", path);
             return ret;
         }
 
-        case TGA:
+        // stb cannot write these, and writes BMP images without alpha; the native writers take the whole image
+        case BMP:
+        case QOI:
+        case PNM:
+        case PAM:
         {
-            bool ret;
-            if (!(ret = stbi_write_tga(path, w_, h_, nchanns_, data_)))
-                (error::get())->log("Error: unable to save image ", path);
-            return ret;
+            std::unique_ptr<raster_writer> writer(raster_writer::create(path, type, w_, h_, nchanns_, depth_, false, compression_));
+            if (!writer) {
+                return false;
+            }
+
+            if (!(writer->write(data_, h_) && writer->close())) {
+                return ((error::get())->log("Error: unable to save image ", path), false);
+            }
+
+            return true;
         }
 
         default: {
@@ -107,99 +258,449 @@ bool steg::image::save(const char* path, const image_type type) const
 
 /*! Load file
  */
-std::size_t steg::image::open(const char* path)
+std::size_t steg::image::open(const char* path, const layout& lay)
 {
     // Return if image already loaded
     if (data_) {
         return 0;
     }
 
-    // Get the data
-    if ((data_ = stbi_load(path, &w_, &h_, &nchanns_, 0)) == nullptr) {
+    layout_ = lay;
+
+    // Get the data; decoded straight from the page cache if the file can be mapped, and is small enough for stb.
+    // 16-bit samples are kept whole. stdin ("-") only goes through the streaming readers
+    mapped_file file;
+    if (::strcmp(path, "-") != 0)
+    {
+        if (file.open(path, false) && file.size() <= static_cast<std::size_t>(INT_MAX))
+        {
+            file.sequential();
+
+            const int size = static_cast<int>(file.size());
+            depth_ = stbi_is_16_bit_from_memory(file.data(), size) ? 2 : 1;
+            data_ = (depth_ == 2) ? reinterpret_cast<unsigned char*>(stbi_load_16_from_memory(file.data(), size, &w_, &h_, &nchanns_, 0)) :
+                                    stbi_load_from_memory(file.data(), size, &w_, &h_, &nchanns_, 0);
+        }
+
+        else
+        {
+            depth_ = stbi_is_16_bit(path) ? 2 : 1;
+            data_ = (depth_ == 2) ? reinterpret_cast<unsigned char*>(stbi_load_16(path, &w_, &h_, &nchanns_, 0)) :
+                                    stbi_load(path, &w_, &h_, &nchanns_, 0);
+        }
+    }
+
+    // Formats stb cannot load, 16-bit PNM and PAM images, and stdin
+    if (data_ == nullptr) {
+        data_ = load(path, w_, h_, nchanns_, depth_);
+    }
+
+    if (data_ == nullptr) {
         return ((error::get())->log("Error: unable to load image ", path), 0);
     }
 
-    return (w_ * h_ * nchanns_);
+    if (!check_bits(layout_, depth_)) {
+        return 0;
+    }
+
+    // Resolve the kernels for this layout; scattered cells are visited through a contiguous copy
+    ops_ = &lsb_select(layout_.scattered ? 1 : stride(), layout_.bits);
+
+    if (layout_.scattered) {
+        scatter_ = scatter(cells(), layout_.seed);
+    }
+
+    // Look for a message header
+    probe();
+
+    return (static_cast<std::size_t>(w_) * h_ * nchanns_ * depth_);
 }
 
-/*! Reads message from image
+/*! Capacity
  */
-std::size_t steg::image::read(char* buff, const std::size_t buffSize)
+bool steg::image::capacity(const char* path, const layout& lay, std::size_t& size)
 {
-    // Zero-out buffer
-    ::memset(buff, 0, buffSize);
+    int w, h, nchanns, depth;
+
+    // stbi_info disagrees with stbi_load on top-down BMPs and on PNGs whose tRNS chunk adds
+    // alpha; the streaming readers agree, and only read the header too
+    std::unique_ptr<raster_reader> reader(raster_reader::probe(path));
+    if (reader)
+    {
+        w = reader->width();
+        h = reader->height();
+        nchanns = reader->channels();
+        depth = reader->depth();
+    }
 
-    // Width x height
-    const std::size_t size = w_ * h_;
+    else if (stbi_info(path, &w, &h, &nchanns)) {
+        depth = stbi_is_16_bit(path) ? 2 : 1;
+    }
 
-    // Just in case
-    // Ensure that buffer is large enough
-    if ((buffSize * 8) < size) {
-        return ((error::get())->log("Error: output buffer is too small to accomodate message size, exiting"), 0);
+    else {
+        return ((error::get())->log("Error: unable to load image ", path), false);
     }
 
-    // Unapply steganography
-    std::size_t i = 0;
-    while (i != size)
+    if (!check_bits(lay, depth)) {
+        return false;
+    }
+
+    const std::size_t ncells = static_cast<std::size_t>(w) * std::abs(h) * (lay.allChanns ? nchanns : 1);
+
+    // Cells before the message, as in header_cells()
+    std::size_t hcells = 0;
+    if (!lay.terminated)
     {
-        const unsigned char r = data_[(nchanns_ * i)];
+        hcells = ((header_size * 8) + lay.bits - 1) / lay.bits;
+        hcells = lay.scattered ? ((hcells + 7) & ~static_cast<std::size_t>(7)) : hcells;
+    }
+
+    size = (ncells > hcells) ? (((ncells - hcells) * lay.bits) / 8) : 0;
+    return true;
+}
 
-        int bit = (r & 0x03);
-        // Check for terminating character
-        if (bit == 0x02) {
-            break; // Reached end of message
+/*! Reads message from image
+ */
+std::size_t steg::image::read(char* buff, const std::size_t buffSize)
+{
+    // No. of cells
+    const std::size_t size = cells();
+
+    std::size_t n;
+
+    // Message follows a header, only read the cells it occupies
+    if (length_ != 0)
+    {
+        // Just in case
+        // Ensure that buffer is large enough
+        if (buffSize < length_) {
+            return ((error::get())->log("Error: output buffer is too small to accomodate message size, exiting"), 0);
         }
 
-        // Parse bit
-        *buff |= (bit << (i % 8));
-        if ((++i % 8) == 0) {
-            ++buff;
+        extract(header_cells((mode_ != -1) ? header_size : header_v1_size), false, buff, message_cells(length_));
+
+        if (crc32c(0, buff, length_) != checksum_) {
+            return ((error::get())->log("Error: message checksum mismatch, image is corrupt, exiting"), 0);
         }
+
+        n = length_;
+    }
+
+    // No header; only images encoded with --legacy end the message with a terminating character instead
+    else if (!layout_.terminated) {
+        return ((error::get())->log("Error: no message header in image; if it was encoded by an older version, decode it with --legacy -m ecb, exiting"), 0);
+    }
+
+    // Otherwise, message ends with a terminating character
+    else
+    {
+        // Just in case
+        // Ensure that buffer is large enough
+        if ((buffSize * 8) < (size * layout_.bits)) {
+            return ((error::get())->log("Error: output buffer is too small to accomodate message size, exiting"), 0);
+        }
+
+        // Unapply steganography
+        n = (extract(0, true, buff, size) * layout_.bits) / 8;
     }
 
     // Terminate and return
-    return ((*buff = 0), (i / 8));
+    if (n < buffSize) {
+        buff[n] = 0;
+    }
+
+    return n;
 }
 
 /*! Writes message to image
  */
 std::size_t steg::image::write(const char* buff, std::size_t buffSize)
 {
-    // Width x height
-    const std::size_t size = w_ * h_;
+    return (append(buff, buffSize) == buffSize && finish()) ? buffSize : 0;
+}
+
+/*! Writes part of a message to image
+ */
+std::size_t steg::image::append(const char* buff, const std::size_t buffSize)
+{
+    // Message ends with a terminating character, or follows a header
+    const std::size_t first = layout_.terminated ? 0 : header_cells(header_size);
+    const std::size_t bits = layout_.bits;
 
     // Ensure that file size is large enough to hold image
-    const char* ptr = buff;
-    if ((buffSize * 8) > size) {
+    if ((first + message_cells(embedded_ + ncarry_ + buffSize)) > cells()) {
         return ((error::get())->log("Error: source image is too small to encode entire message, exiting"), 0);
     }
 
-    // Apply stegonography
-    // Insert message
+    crc_ = crc32c(crc_, buff, buffSize);
+
+    // Top up the bytes carried over from the last call
     std::size_t i = 0;
-    while(i != size && (static_cast<std::size_t>(ptr - buff) != buffSize))
+    if (ncarry_ != 0)
+    {
+        i = std::min(bits - ncarry_, buffSize);
+        ::memcpy(carry_ + ncarry_, buff, i);
+
+        if ((ncarry_ += i) != bits) {
+            return buffSize;
+        }
+
+        embed(first + ((embedded_ * 8) / bits), layout_.terminated, carry_, bits);
+        embedded_ += bits;
+        ncarry_ = 0;
+    }
+
+    // Apply stegonography
+    // Insert whole groups of (bits) bytes, layout_.bits bits per cell; the rest waits for the next call
+    const std::size_t n = ((buffSize - i) / bits) * bits;
+    if (n != 0)
+    {
+        embed(first + ((embedded_ * 8) / bits), layout_.terminated, buff + i, n);
+        embedded_ += n;
+    }
+
+    ncarry_ = buffSize - i - n;
+    ::memcpy(carry_, buff + i + n, ncarry_);
+
+    return buffSize;
+}
+
+/*! Ends a message
+ */
+bool steg::image::finish()
+{
+    const std::size_t first = layout_.terminated ? 0 : header_cells(header_size);
+
+    // The last cell may be partially used
+    if (ncarry_ != 0)
+    {
+        embed(first + ((embedded_ * 8) / layout_.bits), layout_.terminated, carry_, ncarry_);
+        embedded_ += ncarry_;
+        ncarry_ = 0;
+    }
+
+    // Message ends with a terminating character;
+    // "Zero-out" remaining cells using the terminating character
+    if (layout_.terminated)
     {
-        const std::size_t j = nchanns_ *  i;
+        const std::size_t ncells = message_cells(embedded_);
+        terminate(ncells, cells() - ncells);
+    }
+
+    // Otherwise, message follows a header; cells past the message are left untouched
+    else
+    {
+        length_ = embedded_;
+        checksum_ = crc_;
 
-        // Encode single bit
-        unsigned char& r = data_[j];
-        const int bit = (static_cast<unsigned char>(*ptr >> (i % 8)) & 0x01);
+        char header[header_size];
+        header_store(header, length_, checksum_, cipher_, nonce_);
+        embed(0, false, header, header_size);
+    }
+
+    embedded_ = 0;
+    crc_ = 0;
 
-        // Clear the two lower-order bits
-        // and add low order bit
-        r = ((r & ~0x03) | bit);
-        // When done encoding all bits, advance message pointer to next byte
-        if ((++i % 8) == 0) {
-            ++ptr;
+    return true;
+}
+
+/*! Runs tasks
+ */
+template <typename T>
+void steg::image::run(const std::size_t ntasks, const T& task)
+{
+    if (pool_ == nullptr || ntasks < 2)
+    {
+        for (std::size_t i = 0; i != ntasks; ++i) {
+            task(i);
         }
+        return;
+    }
+
+    pool_->run(ntasks, task);
+}
+
+/*! Visits cells
+ */
+template <typename T>
+void steg::image::visit(const std::size_t first, const std::size_t ncells, const bool modify, const T& fn)
+{
+    if (!layout_.scattered) {
+        fn(first_cell() + (stride() * first), stride(), 0, ncells);
+        return;
     }
 
-    // "Zero-out" remaining cells using 0x02 as terminating character
-    for ( ; i != size; ++i)
+    // One tile at a time, through a copy in logical order
+    unsigned char scratch[scatter::tile_cells];
+
+    for (std::size_t i = 0; i != ncells; )
+    {
+        const std::size_t end = ((((first + i) / scatter::tile_cells) + 1) * scatter::tile_cells) - first;
+        const std::size_t n = std::min(end, ncells) - i;
+
+        scatter_.gather(first_cell(), stride(), first + i, n, scratch);
+        const bool more = fn(scratch, 1, i, n);
+
+        if (modify) {
+            scatter_.put(first_cell(), stride(), first + i, n, scratch);
+        }
+
+        if (!more) {
+            return;
+        }
+
+        i += n;
+    }
+}
+
+/*! Embeds message, one band per task
+ */
+void steg::image::embed(const std::size_t first, const bool flag, const char* buff, const std::size_t size)
+{
+    // Band boundaries fall on whole message bytes
+    const std::size_t cells = band_cells();
+    const std::size_t bytes = (cells * layout_.bits) / 8;
+
+    run((size + bytes - 1) / bytes, [&](const std::size_t b) {
+        const std::size_t offset = b * bytes;
+        const std::size_t n = std::min(bytes, size - offset);
+
+        visit(first + (b * cells), message_cells(n), true, [&](unsigned char* data, const int stride, const std::size_t i, const std::size_t m) {
+            const std::size_t o = (i * layout_.bits) / 8;
+            ops_->embed(data, stride, layout_.bits, flag, buff + offset + o, std::min((m * layout_.bits) / 8, n - o));
+            return true;
+        });
+    });
+}
+
+/*! Stamps terminators, one band per task
+ */
+void steg::image::terminate(const std::size_t first, const std::size_t ncells)
+{
+    const std::size_t cells = band_cells();
+
+    run((ncells + cells - 1) / cells, [&](const std::size_t b) {
+        const std::size_t offset = b * cells;
+
+        visit(first + offset, std::min(cells, ncells - offset), true, [&](unsigned char* data, const int stride, const std::size_t, const std::size_t n) {
+            ops_->terminate(data, stride, layout_.bits, n);
+            return true;
+        });
+    });
+}
+
+/*! Extracts message, one band per task
+ */
+std::size_t steg::image::extract(const std::size_t first, const bool flag, char* buff, const std::size_t ncells)
+{
+    // Band boundaries fall on whole message bytes
+    const std::size_t cells = band_cells();
+    const std::size_t bytes = (cells * layout_.bits) / 8;
+    const std::size_t nbands = (ncells + cells - 1) / cells;
+
+    // The terminator may be anywhere; go a few bands at a time so that
+    // short messages don't pay for scanning the whole image
+    const std::size_t step = flag ? (pool_ ? 2 * pool_->size() : 1) : nbands;
+
+    std::unique_ptr<std::size_t[]> counts(new std::size_t[step]);
+
+    for (std::size_t b0 = 0; b0 < nbands; b0 += step)
     {
-        unsigned char& r = data_[(nchanns_ * i)];
-        r = ((r & ~0x03) | 0x02);
+        const std::size_t n = std::min(step, nbands - b0);
+
+        run(n, [&](const std::size_t i) {
+            const std::size_t b = b0 + i;
+            const std::size_t offset = b * cells;
+
+            counts[i] = 0;
+            visit(first + offset, std::min(cells, ncells - offset), false, [&](unsigned char* data, const int stride, const std::size_t j, const std::size_t n) {
+                const std::size_t r = ops_->extract(data, stride, layout_.bits, flag, buff + (b * bytes) + ((j * layout_.bits) / 8), n);
+                counts[i] = j + r;
+                return r == n; // Stop at the terminator
+            });
+        });
+
+        // The first band that stops short holds the terminator
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            const std::size_t offset = (b0 + i) * cells;
+            if (counts[i] != std::min(cells, ncells - offset)) {
+                return offset + counts[i];
+            }
+        }
+    }
+
+    return ncells;
+}
+
+/*! No. of cells per band
+ */
+std::size_t steg::image::band_cells() const
+{
+    return std::max<std::size_t>((band_size / stride()) & ~static_cast<std::size_t>(7), 8);
+}
+
+/*! First cell
+ */
+unsigned char* steg::image::first_cell() const
+{
+    return data_ + lsb_offset(depth_);
+}
+
+/*! No. of cells taken up by the header
+ */
+std::size_t steg::image::header_cells(const std::size_t size) const
+{
+    // Scattered messages start on a whole byte of a tile, see visit()
+    const std::size_t hcells = message_cells(size);
+    return layout_.scattered ? ((hcells + 7) & ~static_cast<std::size_t>(7)) : hcells;
+}
+
+/*! Tells whether a file type keeps the channels
+ */
+bool steg::image::keeps_channels(const image_type type, const int nchanns)
+{
+    return nchanns >= 3 || (type != BMP && type != QOI);
+}
+
+/*! Looks for a message header
+ */
+void steg::image::probe()
+{
+    length_ = 0;
+    checksum_ = 0;
+    mode_ = -1;
+
+    // No. of cells
+    const std::size_t size = cells();
+
+    if (header_cells(header_v1_size) > size) {
+        return; // Too small
+    }
+
+    // As much of a header as fits; version 1 headers are shorter
+    const std::size_t fits = (header_cells(header_size) <= size) ? header_size : header_v1_size;
+
+    char header[header_size] = {  };
+    extract(0, false, header, message_cells(fits));
+
+    std::uint64_t length;
+    std::uint32_t checksum;
+    int mode;
+    std::size_t hsize;
+
+    if (!header_load(header, length, checksum, mode, recorded_, hsize) || hsize > fits) {
+        return; // No header
+    }
+
+    const std::size_t hcells = header_cells(hsize);
+
+    // Ensure the message fits in the image
+    if (length == 0 || length > (((size - hcells) * layout_.bits) / 8)) {
+        return;
     }
 
-    return size;
+    length_ = length;
+    checksum_ = checksum;
+    mode_ = mode;
 }
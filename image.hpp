@@ -4,13 +4,26 @@
 #ifndef _IMAGE_HPP
 #define _IMAGE_HPP
 
+#include <cstdint>
+#include <cstring>
+
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
+#include "compression.hpp"
+#include "layout.hpp"
+#include "scatter.hpp"
+
 namespace steg {
+    // Fwd. decl.
+    struct lsb_ops;
+    class thread_pool;
+
     /// @class
     class image {
     public:
 
         /// Type of image file
-        enum image_type { NIL, PNG, BMP, TGA };
+        enum image_type { NIL, PNG, BMP, TGA, QOI, PNM, PAM };
 
         /// dtor.
         ~image();
@@ -26,7 +39,37 @@ namespace steg {
         /// No copy assignment operator defined, this is a non-copyable object
         image& operator=(image&& other);
 
-        /// @return    the size of the message
+        /// Spreads embedding and extraction over a pool of threads
+        /// @param pool    worker threads, or nullptr to run on the calling thread only
+        inline void set_pool(thread_pool* pool) {
+            pool_ = pool;
+        }
+
+        /// Picks how PNG images are compressed on save
+        /// @param comp    deflate implementation and level
+        inline void set_compression(const compression& comp) {
+            compression_ = comp;
+        }
+
+        /// Picks the cipher mode and nonce recorded in the header on save
+        /// @param mode     cipher mode the message was encrypted with
+        /// @param nonce    message nonce, cipher_nonce_size bytes
+        inline void set_cipher(const cipher::mode_type mode, const char* nonce) {
+            cipher_ = mode;
+            ::memcpy(nonce_, nonce, sizeof(nonce_));
+        }
+
+        /// @return    the cipher mode recorded in the header, a cipher::mode_type; -1 if the image has no header, or one that does not record it
+        inline int cipher_mode() const {
+            return mode_;
+        }
+
+        /// @return    the nonce recorded in the header, cipher_nonce_size bytes; nullptr if the image has no header, or one that does not record it
+        inline const char* cipher_nonce() const {
+            return (mode_ != -1) ? recorded_ : nullptr;
+        }
+
+        /// @return    the size of the message, or an upper bound if the image has no header
         std::size_t size() const;
 
         /// Saves file
@@ -37,8 +80,22 @@ namespace steg {
 
         /// Loads file
         /// @param path    path/to/image/file
-        /// @return        image size
-        std::size_t open(const char* path);
+        /// @param lay     how the message is laid out over the pixels; 16-bit images take up to 8 bits per cell
+        /// @return        image size, in bytes
+        std::size_t open(const char* path, const layout& lay);
+
+        /// Works out how much an image can carry from its header alone, without decoding it
+        /// @param path    path/to/image/file
+        /// @param lay     how the message would be laid out over the pixels
+        /// @param size    room for the message, in bytes [out]
+        /// @return        true on success, false if the header could not be read
+        static bool capacity(const char* path, const layout& lay, std::size_t& size);
+
+        /// Tells whether a file type keeps the channels of an image as they are; BMP and QOI store grey pixels as RGB
+        /// @param type       output image file type
+        /// @param nchanns    no. of channels
+        /// @return           true if every channel is saved where it is
+        static bool keeps_channels(const image_type type, const int nchanns);
 
         /// Reads message from image
         /// @param buff[out]    unallocated output buffer
@@ -52,8 +109,85 @@ namespace steg {
         /// @return            number of bytes written
         std::size_t write(const char* buff, const std::size_t buffSize);
 
+        /// Writes the next part of a message to image, for messages written a chunk at a time; finish() ends the message
+        /// @param buff        next part of the message [in]
+        /// @param buffSize    its size
+        /// @return            number of bytes written, 0 if the message no longer fits
+        std::size_t append(const char* buff, const std::size_t buffSize);
+
+        /// Ends a message written with append(): writes its header, or stamps terminators past it
+        /// @return    true on success, false otherwise
+        bool finish();
+
     private:
 
+        /*! Looks for a message header, sets length_ and checksum_
+         */
+        void probe();
+
+        /*! Embeds message into the cells starting at first, one band per task
+         */
+        void embed(const std::size_t first, const bool flag, const char* buff, const std::size_t size);
+
+        /*! Stamps the terminating character over ncells cells starting at first, one band per task
+         */
+        void terminate(const std::size_t first, const std::size_t ncells);
+
+        /*! Extracts message from the ncells cells starting at first, one band per task
+         * @return    no. of cells read before the terminator
+         */
+        std::size_t extract(const std::size_t first, const bool flag, char* buff, const std::size_t ncells);
+
+        /*! Calls fn(data, stride, i, n) over runs of the ncells cells starting at first,
+         * where data is the i-th cell of the range and the run is n cells long
+         * Scattered cells are copied to a contiguous buffer (stride 1), and back if modify
+         * is set; runs end at tile boundaries. Stops early if fn returns false
+         */
+        template <typename T>
+        void visit(const std::size_t first, const std::size_t ncells, const bool modify, const T& fn);
+
+        /*! Runs task(i) for every i in [0, ntasks), across the pool if there is one
+         */
+        template <typename T>
+        void run(const std::size_t ntasks, const T& task);
+
+        /*! Helper
+         * No. of cells per band; a multiple of 8, so that every band starts on a whole message byte
+         */
+        std::size_t band_cells() const;
+
+        /*! Helper
+         * No. of cells that can carry the message
+         */
+        inline std::size_t cells() const {
+            return static_cast<std::size_t>(w_) * h_ * (layout_.allChanns ? nchanns_ : 1);
+        }
+
+        /*! Helper
+         * No. of cells taken up by a header of the given size; header_v1_size for images
+         * whose header records no cipher mode
+         */
+        std::size_t header_cells(const std::size_t size) const;
+
+        /*! Helper
+         * No. of cells taken up by a message of the given size; the last one may be partially used
+         */
+        inline std::size_t message_cells(const std::size_t size) const {
+            return ((size * 8) + layout_.bits - 1) / layout_.bits;
+        }
+
+        /*! Helper
+         * Distance between cells, in bytes
+         */
+        inline int stride() const {
+            return (layout_.allChanns ? 1 : nchanns_) * depth_;
+        }
+
+        /*! Helper
+         * First cell; the low-order byte of the first sample
+         */
+        unsigned char* first_cell() const;
+
         // Non-copyable
         explicit image(image&) = delete;
         explicit image(const image&) = delete;
@@ -63,6 +197,44 @@ namespace steg {
 
         // Image width, height, no. of channels
         int w_, h_, nchanns_;
+
+        // Bytes per sample; 16-bit samples are in host byte order
+        int depth_;
+
+        // Message layout
+        layout layout_;
+
+        // Kernels for the message layout
+        const lsb_ops* ops_;
+
+        // Visiting order of cells, if scattered
+        scatter scatter_;
+
+        // Message size and checksum, from the header; 0 if the image has none
+        std::size_t length_;
+        std::uint32_t checksum_;
+
+        // Cipher mode to record in the header, and the one recorded in it; -1 if none
+        cipher::mode_type cipher_;
+        int mode_;
+
+        // Nonce to record in the header, and the one recorded in it, if mode_ is not -1
+        char nonce_[cipher_nonce_size];
+        char recorded_[cipher_nonce_size];
+
+        // Message bytes embedded by append() so far, a multiple of the bits per cell, and their checksum
+        std::size_t embedded_;
+        std::uint32_t crc_;
+
+        // Message bytes appended, but not embedded yet; (bits) bytes fill 8 cells exactly
+        char carry_[8];
+        std::size_t ncarry_;
+
+        // Worker threads, not owned; nullptr if single-threaded
+        thread_pool* pool_;
+
+        // PNG compression
+        compression compression_;
     };
 }
 
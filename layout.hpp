@@ -0,0 +1,34 @@
+/* layout.hpp -- v1.0 -- describes how a message is laid out over the pixels of an image
+   Author: Sam Y. 2021 */
+
+#ifndef _LAYOUT_HPP
+#define _LAYOUT_HPP
+
+#include <cstdint>
+
+namespace steg {
+    /// @class layout
+    struct layout {
+        // No. of low-order bits that carry the message in each cell, 1 to max_bits()
+        int bits;
+        // Cells are every channel of every pixel (true), or the first channel only (false)
+        bool allChanns;
+        // Message ends with a terminating character (true), or follows a header that holds its size (false)
+        bool terminated;
+        // Cells are visited in a key-derived order (true), or from the first pixel on (false)
+        bool scattered;
+        // Key-derived seed of the visiting order, if scattered
+        std::uint64_t seed;
+    };
+
+    /// Most message bits a cell can carry; a cell is the low-order byte of a sample, so
+    /// 16-bit samples have room for more of them, and for the flag bit above them
+    /// @param lay      message layout
+    /// @param depth    bytes per sample, 1 or 2
+    /// @return         4 for 8-bit samples; 8 for 16-bit samples, 7 in the terminated layout
+    inline int max_bits(const layout& lay, const int depth) {
+        return (depth == 2) ? (lay.terminated ? 7 : 8) : 4;
+    }
+}
+
+#endif
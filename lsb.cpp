@@ -0,0 +1,157 @@
+/* lsb.cpp -- v1.0 -- kernels used for embedding bits into, and extracting bits from, image cells
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+
+#include "cpu.hpp"
+#include "lsb.hpp"
+#include "lsb_kernel.hpp"
+
+namespace {
+    /*! Helper
+     * Kernels specialized for a cell layout; the widest vector kernels the host
+     * supports take over where they apply
+     */
+    template <int stride,
+              int bits>
+    steg::lsb_ops specialize()
+    {
+        typedef steg::lsb_kernel<stride, bits> kernel;
+        steg::lsb_ops ops = { &kernel::embed, &kernel::terminate, &kernel::extract };
+
+#if defined(STEG_X86)
+        // The vector kernels only take strides 1 to 4
+        if (stride > 4) {
+            return ops;
+        }
+
+        if (steg::cpu_supports(steg::CPU_AVX512))
+        {
+            ops.terminate = &steg::lsb_terminate_avx512;
+            if (bits == 1)
+            {
+                ops.embed = &steg::lsb_embed_avx512;
+                ops.extract = &steg::lsb_extract_avx512;
+            }
+        }
+
+        else if (steg::cpu_supports(steg::CPU_AVX2))
+        {
+            ops.terminate = &steg::lsb_terminate_avx2;
+            if (bits == 1)
+            {
+                ops.embed = &steg::lsb_embed_avx2;
+                ops.extract = &steg::lsb_extract_avx2;
+            }
+        }
+
+        else if (steg::cpu_supports(steg::CPU_SSE2))
+        {
+            ops.terminate = &steg::lsb_terminate_sse2;
+            if (bits == 1)
+            {
+                ops.embed = &steg::lsb_embed_sse2;
+                ops.extract = &steg::lsb_extract_sse2;
+            }
+        }
+#endif
+
+        return ops;
+    }
+}
+
+/*! Resolves the kernels for a cell layout
+ */
+const steg::lsb_ops& steg::lsb_select(const int stride, const int bits)
+{
+    // Any other layout
+    static const lsb_ops scalar = { &lsb_embed_scalar, &lsb_terminate_scalar, &lsb_extract_scalar };
+
+    // The layouts stb returns, and those of 16-bit samples, indexed by [stride - 1][bits - 1]; resolved on first use
+    static const lsb_ops table[8][8] = {
+        { specialize<1, 1>(), specialize<1, 2>(), specialize<1, 3>(), specialize<1, 4>(), specialize<1, 5>(), specialize<1, 6>(), specialize<1, 7>(), specialize<1, 8>() },
+        { specialize<2, 1>(), specialize<2, 2>(), specialize<2, 3>(), specialize<2, 4>(), specialize<2, 5>(), specialize<2, 6>(), specialize<2, 7>(), specialize<2, 8>() },
+        { specialize<3, 1>(), specialize<3, 2>(), specialize<3, 3>(), specialize<3, 4>(), specialize<3, 5>(), specialize<3, 6>(), specialize<3, 7>(), specialize<3, 8>() },
+        { specialize<4, 1>(), specialize<4, 2>(), specialize<4, 3>(), specialize<4, 4>(), specialize<4, 5>(), specialize<4, 6>(), specialize<4, 7>(), specialize<4, 8>() },
+        { specialize<5, 1>(), specialize<5, 2>(), specialize<5, 3>(), specialize<5, 4>(), specialize<5, 5>(), specialize<5, 6>(), specialize<5, 7>(), specialize<5, 8>() },
+        { specialize<6, 1>(), specialize<6, 2>(), specialize<6, 3>(), specialize<6, 4>(), specialize<6, 5>(), specialize<6, 6>(), specialize<6, 7>(), specialize<6, 8>() },
+        { specialize<7, 1>(), specialize<7, 2>(), specialize<7, 3>(), specialize<7, 4>(), specialize<7, 5>(), specialize<7, 6>(), specialize<7, 7>(), specialize<7, 8>() },
+        { specialize<8, 1>(), specialize<8, 2>(), specialize<8, 3>(), specialize<8, 4>(), specialize<8, 5>(), specialize<8, 6>(), specialize<8, 7>(), specialize<8, 8>() }
+    };
+
+    if (stride < 1 || stride > 8 || bits < 1 || bits > 8) {
+        return scalar;
+    }
+
+    return table[stride - 1][bits - 1];
+}
+
+/*! Embeds message, one cell at a time
+ */
+void steg::lsb_embed_scalar(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size)
+{
+    const unsigned int mask = ((1 << bits) - 1);
+    // Clears the message bits, and the flag bit above them
+    const unsigned int keep = ~(((flag ? 2 : 1) << bits) - 1);
+
+    // Message bits not yet written, low-order first
+    unsigned int acc = 0;
+    int nacc = 0;
+
+    for (std::size_t i = 0; i != size; ++i)
+    {
+        acc |= (static_cast<unsigned char>(buff[i]) << nacc);
+        for (nacc += 8; nacc >= bits; nacc -= bits, acc >>= bits, data += stride) {
+            *data = ((*data & keep) | (acc & mask));
+        }
+    }
+
+    // Zero-pad the last cell
+    if (nacc != 0) {
+        *data = ((*data & keep) | (acc & mask));
+    }
+}
+
+/*! Stamps terminators, one cell at a time
+ */
+void steg::lsb_terminate_scalar(unsigned char* data, const int stride, const int bits, const std::size_t ncells)
+{
+    const unsigned int keep = ~((2 << bits) - 1);
+    for (std::size_t i = 0; i != ncells; ++i, data += stride) {
+        *data = ((*data & keep) | (1 << bits));
+    }
+}
+
+/*! Extracts message, one cell at a time
+ */
+std::size_t steg::lsb_extract_scalar(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells)
+{
+    const unsigned int mask = ((1 << bits) - 1);
+    // Message bits plus flag bit
+    const unsigned int test = ((2 << bits) - 1);
+
+    // Message bits not yet written, low-order first
+    unsigned int acc = 0;
+    int nacc = 0;
+
+    std::size_t i = 0;
+    for ( ; i != ncells; ++i, data += stride)
+    {
+        const unsigned int cell = (*data & test);
+        // Check for terminating character
+        if (flag && cell == (1u << bits)) {
+            break; // Reached end of message
+        }
+
+        // Parse bits
+        acc |= ((cell & mask) << nacc);
+        if ((nacc += bits) >= 8)
+        {
+            *buff++ = acc;
+            acc >>= 8;
+            nacc -= 8;
+        }
+    }
+
+    return i;
+}
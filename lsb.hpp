@@ -0,0 +1,82 @@
+/* lsb.hpp -- v1.0 -- kernels used for embedding bits into, and extracting bits from, image cells
+   Author: Sam Y. 2021 */
+
+#ifndef _LSB_HPP
+#define _LSB_HPP
+
+#include <cstdint>
+
+namespace steg {
+    // A cell is a byte of a pixel that carries the message; cell i is found at data[stride * i].
+    // With 16-bit samples, a cell is the low-order byte of a sample, see lsb_offset()
+    // Each cell carries (bits) message bits in its low-order bits. In the terminated layout,
+    // these are followed by a flag bit that is only set in the terminating character (1 << bits)
+
+    /// @class lsb_ops
+    /// Kernels for one cell layout, resolved once per image
+    struct lsb_ops {
+
+        /// Embeds message into image cells, (bits) bits per cell
+        /// @param data      first cell [in/out]
+        /// @param stride    distance between cells, in bytes (1 or the no. of channels, times the bytes per sample)
+        /// @param bits      message bits per cell, 1 to 8
+        /// @param flag      clear the flag bit of each cell (terminated layout)
+        /// @param buff      input message [in]
+        /// @param size      input message size; (size * 8 / bits) cells are written, rounded up
+        void (*embed)(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size);
+
+        /// Stamps the terminating character over image cells
+        /// @param data      first cell [in/out]
+        /// @param stride    distance between cells, in bytes (1 or the no. of channels, times the bytes per sample)
+        /// @param bits      message bits per cell, 1 to 8
+        /// @param ncells    number of cells to stamp
+        void (*terminate)(unsigned char* data, const int stride, const int bits, const std::size_t ncells);
+
+        /// Extracts message from image cells, (bits) bits per cell
+        /// @param data      first cell [in]
+        /// @param stride    distance between cells, in bytes (1 or the no. of channels, times the bytes per sample)
+        /// @param bits      message bits per cell, 1 to 8
+        /// @param flag      stop at the first terminating character (terminated layout)
+        /// @param buff      output buffer, at least (ncells * bits / 8) bytes [out]
+        /// @param ncells    number of cells to read
+        /// @return          number of cells read before the terminator; only whole bytes are written
+        std::size_t (*extract)(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells);
+    };
+
+    /// Offset of the low-order byte of a sample, which holds the cell; wider samples are in host byte order
+    /// @param depth    bytes per sample, 1 or 2
+    inline int lsb_offset(const int depth) {
+        static const std::uint16_t one = 1;
+        return (depth == 2 && *reinterpret_cast<const unsigned char*>(&one) == 0) ? 1 : 0;
+    }
+
+    /// Resolves the kernels for a cell layout
+    /// @param stride    distance between cells, in bytes
+    /// @param bits      message bits per cell
+    /// @return          kernels specialized for the layout, or portable ones if there are none
+    const lsb_ops& lsb_select(const int stride, const int bits);
+
+    /// Portable implementations, any stride
+    void lsb_embed_scalar(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size);
+    void lsb_terminate_scalar(unsigned char* data, const int stride, const int bits, const std::size_t ncells);
+    std::size_t lsb_extract_scalar(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells);
+
+    /// Vector implementations below are x86 only, and must only be called if cpu_supports() the extension
+
+    /// SSE2 implementations, 16 cells per step; strides 1 to 4 only, one bit per cell (except terminate)
+    void lsb_embed_sse2(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size);
+    void lsb_terminate_sse2(unsigned char* data, const int stride, const int bits, const std::size_t ncells);
+    std::size_t lsb_extract_sse2(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells);
+
+    /// AVX2 implementations, 32 cells per step; strides 1 to 4 only, one bit per cell (except terminate)
+    void lsb_embed_avx2(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size);
+    void lsb_terminate_avx2(unsigned char* data, const int stride, const int bits, const std::size_t ncells);
+    std::size_t lsb_extract_avx2(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells);
+
+    /// AVX-512BW and BMI2 implementations, 64 cells per step; strides 1 to 4 only, one bit per cell (except terminate)
+    void lsb_embed_avx512(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size);
+    void lsb_terminate_avx512(unsigned char* data, const int stride, const int bits, const std::size_t ncells);
+    std::size_t lsb_extract_avx512(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells);
+}
+
+#endif
@@ -0,0 +1,246 @@
+/* lsb_avx2.cpp -- v1.0 -- AVX2 kernels used for embedding bits into, and extracting bits from, image cells
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstring>
+
+#include "cpu.hpp"
+#include "lsb.hpp"
+#include "lsb_kernel.hpp"
+
+#if defined(STEG_X86)
+
+// Everything below is built for AVX2, and only runs if the host supports it (see lsb_select)
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+namespace {
+    /*! @class: lane constants for a block of 32 cells
+     * A block spans S vectors; only the lanes that hold a cell are modified
+     */
+    template <int S>
+    struct block {
+
+        __m256i bit[S];   // > mask of the message bit each cell takes, 0 for non-cell lanes
+        __m256i index[S]; // > which of the block's four bytes the cell takes its bit from
+        __m256i one[S];   // > 0x01 for cell lanes
+        __m256i keep[S];  // > clears the message (and flag) bits in cell lanes, 0xff otherwise
+        __m256i term[S];  // > the terminating character in cell lanes
+
+        inline block(const int bits, const bool flag) {
+
+            unsigned char bit_[S * 32], index_[S * 32], one_[S * 32], keep_[S * 32], term_[S * 32];
+            for (int b = 0; b != S * 32; ++b)
+            {
+                const int i = b / S;
+                const bool cell = (b % S) == 0;
+
+                bit_[b] = cell ? (1 << (i % 8)) : 0;
+                index_[b] = (i / 8);
+                one_[b] = cell ? 0x01 : 0x00;
+                keep_[b] = cell ? ~(((flag ? 2 : 1) << bits) - 1) : 0xff;
+                term_[b] = cell ? (1 << bits) : 0x00;
+            }
+
+            for (int j = 0; j != S; ++j)
+            {
+                bit[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bit_ + 32 * j));
+                index[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index_ + 32 * j));
+                one[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(one_ + 32 * j));
+                keep[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keep_ + 32 * j));
+                term[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(term_ + 32 * j));
+            }
+        }
+    };
+
+    /*! Embeds four message bytes per step
+     */
+    template <int S>
+    void embed(unsigned char* data, const bool flag, const char* buff, const std::size_t size)
+    {
+        const block<S> blk(1, flag);
+
+        std::size_t i = 0;
+        for ( ; (i + 4) <= size; i += 4, data += (32 * S))
+        {
+            // Broadcast all four bytes into each 128-bit lane, then pick one per lane
+            int word;
+            ::memcpy(&word, buff + i, sizeof(word));
+            const __m256i bytes = _mm256_set1_epi32(word);
+
+            for (int j = 0; j != S; ++j)
+            {
+                const __m256i byte = _mm256_shuffle_epi8(bytes, blk.index[j]);
+                // Expand bit to 0x00/0x01
+                const __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(byte, blk.bit[j]), blk.bit[j]), blk.one[j]);
+
+                __m256i* const ptr = reinterpret_cast<__m256i*>(data + (32 * j));
+                _mm256_storeu_si256(ptr, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(ptr), blk.keep[j]), bits));
+            }
+        }
+
+        // Trailing bytes
+        steg::lsb_kernel<S, 1>::embed(data, S, 1, flag, buff + i, size - i);
+    }
+
+    /*! Stamps thirty-two terminators per step
+     */
+    template <int S>
+    void terminate(unsigned char* data, const int bits, const std::size_t ncells)
+    {
+        const block<S> blk(bits, true);
+
+        std::size_t i = 0;
+        for ( ; (i + 32) <= ncells; i += 32, data += (32 * S))
+        {
+            for (int j = 0; j != S; ++j)
+            {
+                __m256i* const ptr = reinterpret_cast<__m256i*>(data + (32 * j));
+                _mm256_storeu_si256(ptr, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(ptr), blk.keep[j]), blk.term[j]));
+            }
+        }
+
+        // Trailing cells
+        steg::lsb_terminate_scalar(data, S, bits, ncells - i);
+    }
+
+    /*! Packs the cells of a block of 32 into a single vector
+     */
+    template <int S>
+    inline __m256i gather(const unsigned char* data);
+
+    template <>
+    inline __m256i gather<1>(const unsigned char* data) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    }
+
+    template <>
+    inline __m256i gather<2>(const unsigned char* data) {
+        const __m256i lo = _mm256_set1_epi16(0x00ff);
+        const __m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), lo);
+        const __m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32)), lo);
+        // Packing works within 128-bit lanes, restore cell order
+        return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+    }
+
+    template <>
+    inline __m256i gather<3>(const unsigned char* data) {
+        // Cells 0-15 and 16-31 sit at the same offsets within 48-byte halves,
+        // so one set of shuffles serves both lanes
+        const __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), 1);
+        const __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16))),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 64)), 1);
+        const __m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32))),
+                                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 80)), 1);
+
+        const __m256i sa = _mm256_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i sb = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+        const __m256i sc = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13,
+                                            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+
+        return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, sa), _mm256_shuffle_epi8(b, sb)),
+                               _mm256_shuffle_epi8(c, sc));
+    }
+
+    template <>
+    inline __m256i gather<4>(const unsigned char* data) {
+        const __m256i lo = _mm256_set1_epi32(0x000000ff);
+        const __m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), lo);
+        const __m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32)), lo);
+        const __m256i c = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 64)), lo);
+        const __m256i d = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 96)), lo);
+        // Packing works within 128-bit lanes, restore cell order
+        return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d)),
+                                           _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    }
+
+    /*! Extracts four message bytes per step
+     */
+    template <int S,
+              bool flag>
+    std::size_t extract(const unsigned char* data, char* buff, const std::size_t ncells)
+    {
+        const __m256i three = _mm256_set1_epi8(0x03);
+        const __m256i two = _mm256_set1_epi8(0x02);
+
+        std::size_t i = 0;
+        for ( ; (i + 32) <= ncells; i += 32, data += (32 * S), buff += 4)
+        {
+            const __m256i cells = gather<S>(data);
+
+            // Low-order bit of every cell, cell 0 first
+            const unsigned int bits = _mm256_movemask_epi8(_mm256_slli_epi16(cells, 7));
+            // Check for terminating character
+            const unsigned int term = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(cells, three), two));
+
+            if (flag && term != 0)
+            {
+                const int n = __builtin_ctz(term);
+                ::memcpy(buff, &bits, n / 8);
+                return (i + n); // Reached end of message
+            }
+
+            ::memcpy(buff, &bits, 4);
+        }
+
+        // Trailing cells
+        return i + steg::lsb_kernel<S, 1>::extract(data, S, 1, flag, buff, ncells - i);
+    }
+}
+
+/*! Embeds message, 32 cells per step
+ */
+void steg::lsb_embed_avx2(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size)
+{
+    switch (stride)
+    {
+        case 1: return embed<1>(data, flag, buff, size);
+        case 2: return embed<2>(data, flag, buff, size);
+        case 3: return embed<3>(data, flag, buff, size);
+        case 4: return embed<4>(data, flag, buff, size);
+
+        default: {
+            return lsb_embed_scalar(data, stride, bits, flag, buff, size);
+        }
+    }
+}
+
+/*! Stamps terminators, 32 cells per step
+ */
+void steg::lsb_terminate_avx2(unsigned char* data, const int stride, const int bits, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return terminate<1>(data, bits, ncells);
+        case 2: return terminate<2>(data, bits, ncells);
+        case 3: return terminate<3>(data, bits, ncells);
+        case 4: return terminate<4>(data, bits, ncells);
+
+        default: {
+            return lsb_terminate_scalar(data, stride, bits, ncells);
+        }
+    }
+}
+
+/*! Extracts message, 32 cells per step
+ */
+std::size_t steg::lsb_extract_avx2(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return flag ? extract<1, true>(data, buff, ncells) : extract<1, false>(data, buff, ncells);
+        case 2: return flag ? extract<2, true>(data, buff, ncells) : extract<2, false>(data, buff, ncells);
+        case 3: return flag ? extract<3, true>(data, buff, ncells) : extract<3, false>(data, buff, ncells);
+        case 4: return flag ? extract<4, true>(data, buff, ncells) : extract<4, false>(data, buff, ncells);
+
+        default: {
+            return lsb_extract_scalar(data, stride, bits, flag, buff, ncells);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,200 @@
+/* lsb_avx512.cpp -- v1.0 -- AVX-512 kernels used for embedding bits into, and extracting bits from, image cells
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu.hpp"
+#include "lsb.hpp"
+#include "lsb_kernel.hpp"
+
+#if defined(STEG_X86)
+
+// Everything below is built for AVX-512BW and BMI2, and only runs if the host supports them (see lsb_select)
+#pragma GCC target("avx512f,avx512bw,bmi2")
+
+#include <immintrin.h>
+
+namespace {
+    /*! @class: lane masks for a block of 64 cells
+     * A block spans S vectors; cell i sits in lane (S * i) of the block, so a vector
+     * holds a run of cells that BMI2 can deposit bits into, or extract bits from
+     */
+    template <int S>
+    struct block {
+
+        std::uint64_t cells[S]; // > lanes that hold a cell
+        int first[S];           // > index of the vector's first cell within the block
+        __m512i keep[S];        // > clears the message (and flag) bits in cell lanes, 0xff otherwise
+        __m512i term[S];        // > the terminating character in cell lanes
+
+        inline block(const int bits, const bool flag) {
+
+            int n = 0;
+            for (int j = 0; j != S; ++j)
+            {
+                std::uint64_t mask = 0;
+                for (int l = 0; l != 64; ++l) {
+                    if (((64 * j) + l) % S == 0) {
+                        mask |= (1ull << l);
+                    }
+                }
+
+                cells[j] = mask;
+                first[j] = n;
+                keep[j] = _mm512_mask_blend_epi8(mask, _mm512_set1_epi8(-1), _mm512_set1_epi8(~(((flag ? 2 : 1) << bits) - 1)));
+                term[j] = _mm512_maskz_set1_epi8(mask, (1 << bits));
+
+                n += __builtin_popcountll(mask);
+            }
+        }
+    };
+
+    /*! Embeds eight message bytes per step
+     */
+    template <int S>
+    void embed(unsigned char* data, const bool flag, const char* buff, const std::size_t size)
+    {
+        const block<S> blk(1, flag);
+        const __m512i one = _mm512_set1_epi8(0x01);
+
+        std::size_t i = 0;
+        for ( ; (i + 8) <= size; i += 8, data += (64 * S))
+        {
+            std::uint64_t word;
+            ::memcpy(&word, buff + i, sizeof(word));
+
+            for (int j = 0; j != S; ++j)
+            {
+                // Scatter the vector's run of message bits over its cell lanes
+                const __mmask64 bits = _pdep_u64(word >> blk.first[j], blk.cells[j]);
+
+                __m512i* const ptr = reinterpret_cast<__m512i*>(data + (64 * j));
+                _mm512_storeu_si512(ptr, _mm512_or_si512(_mm512_and_si512(_mm512_loadu_si512(ptr), blk.keep[j]),
+                                                         _mm512_maskz_mov_epi8(bits, one)));
+            }
+        }
+
+        // Trailing bytes
+        steg::lsb_kernel<S, 1>::embed(data, S, 1, flag, buff + i, size - i);
+    }
+
+    /*! Stamps sixty-four terminators per step
+     */
+    template <int S>
+    void terminate(unsigned char* data, const int bits, const std::size_t ncells)
+    {
+        const block<S> blk(bits, true);
+
+        std::size_t i = 0;
+        for ( ; (i + 64) <= ncells; i += 64, data += (64 * S))
+        {
+            for (int j = 0; j != S; ++j)
+            {
+                __m512i* const ptr = reinterpret_cast<__m512i*>(data + (64 * j));
+                _mm512_storeu_si512(ptr, _mm512_or_si512(_mm512_and_si512(_mm512_loadu_si512(ptr), blk.keep[j]), blk.term[j]));
+            }
+        }
+
+        // Trailing cells
+        steg::lsb_terminate_scalar(data, S, bits, ncells - i);
+    }
+
+    /*! Extracts eight message bytes per step
+     */
+    template <int S,
+              bool flag>
+    std::size_t extract(const unsigned char* data, char* buff, const std::size_t ncells)
+    {
+        const block<S> blk(1, flag);
+        const __m512i one = _mm512_set1_epi8(0x01);
+        const __m512i three = _mm512_set1_epi8(0x03);
+        const __m512i two = _mm512_set1_epi8(0x02);
+
+        std::size_t i = 0;
+        for ( ; (i + 64) <= ncells; i += 64, data += (64 * S), buff += 8)
+        {
+            // Low-order bit of every cell, and terminating characters; cell 0 first
+            std::uint64_t bits = 0, term = 0;
+
+            for (int j = 0; j != S; ++j)
+            {
+                const __m512i cells = _mm512_loadu_si512(reinterpret_cast<const __m512i*>(data + (64 * j)));
+
+                // Gather the bits of the cell lanes into the vector's run of message bits
+                bits |= (_pext_u64(_mm512_test_epi8_mask(cells, one), blk.cells[j]) << blk.first[j]);
+
+                if (flag) {
+                    term |= (_pext_u64(_mm512_cmpeq_epi8_mask(_mm512_and_si512(cells, three), two), blk.cells[j]) << blk.first[j]);
+                }
+            }
+
+            // Check for terminating character
+            if (flag && term != 0)
+            {
+                const int n = __builtin_ctzll(term);
+                ::memcpy(buff, &bits, n / 8);
+                return (i + n); // Reached end of message
+            }
+
+            ::memcpy(buff, &bits, 8);
+        }
+
+        // Trailing cells
+        return i + steg::lsb_kernel<S, 1>::extract(data, S, 1, flag, buff, ncells - i);
+    }
+}
+
+/*! Embeds message, 64 cells per step
+ */
+void steg::lsb_embed_avx512(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size)
+{
+    switch (stride)
+    {
+        case 1: return embed<1>(data, flag, buff, size);
+        case 2: return embed<2>(data, flag, buff, size);
+        case 3: return embed<3>(data, flag, buff, size);
+        case 4: return embed<4>(data, flag, buff, size);
+
+        default: {
+            return lsb_embed_scalar(data, stride, bits, flag, buff, size);
+        }
+    }
+}
+
+/*! Stamps terminators, 64 cells per step
+ */
+void steg::lsb_terminate_avx512(unsigned char* data, const int stride, const int bits, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return terminate<1>(data, bits, ncells);
+        case 2: return terminate<2>(data, bits, ncells);
+        case 3: return terminate<3>(data, bits, ncells);
+        case 4: return terminate<4>(data, bits, ncells);
+
+        default: {
+            return lsb_terminate_scalar(data, stride, bits, ncells);
+        }
+    }
+}
+
+/*! Extracts message, 64 cells per step
+ */
+std::size_t steg::lsb_extract_avx512(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return flag ? extract<1, true>(data, buff, ncells) : extract<1, false>(data, buff, ncells);
+        case 2: return flag ? extract<2, true>(data, buff, ncells) : extract<2, false>(data, buff, ncells);
+        case 3: return flag ? extract<3, true>(data, buff, ncells) : extract<3, false>(data, buff, ncells);
+        case 4: return flag ? extract<4, true>(data, buff, ncells) : extract<4, false>(data, buff, ncells);
+
+        default: {
+            return lsb_extract_scalar(data, stride, bits, flag, buff, ncells);
+        }
+    }
+}
+
+#endif
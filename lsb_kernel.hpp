@@ -0,0 +1,148 @@
+/* lsb_kernel.hpp -- v1.0 -- portable kernels specialized at compile time for a cell layout
+   Author: Sam Y. 2021 */
+
+#ifndef _LSB_KERNEL_HPP
+#define _LSB_KERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace steg {
+    //! @class lsb_kernel
+    //! Same contract as the kernels in lsb.hpp; the stride and bits arguments
+    //! are ignored, the template arguments are used instead
+    template <int stride,
+              int bits>
+    class lsb_kernel {
+    public:
+
+        /// Embeds message into image cells, (bits) bits per cell
+        inline static void embed(unsigned char* data, const int, const int, const bool flag, const char* buff, const std::size_t size);
+
+        /// Stamps the terminating character over image cells
+        inline static void terminate(unsigned char* data, const int, const int, const std::size_t ncells);
+
+        /// Extracts message from image cells, (bits) bits per cell
+        inline static std::size_t extract(const unsigned char* data, const int, const int, const bool flag, char* buff, const std::size_t ncells);
+
+    private:
+
+        /*! Helper
+         * Writes out the whole bytes held by the first ncells cells of a group
+         */
+        inline static int flush(char* buff, const std::uint64_t word, const int ncells) {
+            for (int j = 0; j != (ncells * bits) / 8; ++j) {
+                buff[j] = static_cast<char>(word >> (8 * j));
+            }
+            return ncells;
+        }
+
+        // Message bits of a cell
+        static const unsigned int mask = ((1u << bits) - 1);
+
+        // A group is the shortest run of whole bytes that fills whole cells; up to 7 bytes, with 16-bit samples
+        static const int group_bytes = (bits % 2) ? bits : (bits % 4) ? (bits / 2) : 1;
+        static const int group_cells = (group_bytes * 8) / bits;
+    };
+
+    /*! Embeds message, one group at a time
+     */
+    template <int stride,
+              int bits>
+    void lsb_kernel<stride, bits>::embed(unsigned char* data, const int, const int, const bool flag, const char* buff, const std::size_t size)
+    {
+        // Clears the message bits, and the flag bit above them
+        const unsigned int keep = ~(((flag ? 2u : 1u) << bits) - 1);
+        const unsigned char* const inp = reinterpret_cast<const unsigned char*>(buff);
+
+        std::size_t i = 0;
+        for ( ; (i + group_bytes) <= size; i += group_bytes, data += (group_cells * stride))
+        {
+            std::uint64_t word = 0;
+            for (int j = 0; j != group_bytes; ++j) {
+                word |= (static_cast<std::uint64_t>(inp[i + j]) << (8 * j));
+            }
+
+            for (int c = 0; c != group_cells; ++c) {
+                data[c * stride] = ((data[c * stride] & keep) | ((word >> (c * bits)) & mask));
+            }
+        }
+
+        // Trailing bytes, zero-pad the last cell
+        if (i != size)
+        {
+            std::uint64_t word = 0;
+            for (int j = 0; (i + j) != size; ++j) {
+                word |= (static_cast<std::uint64_t>(inp[i + j]) << (8 * j));
+            }
+
+            const int ncells = ((static_cast<int>(size - i) * 8) + bits - 1) / bits;
+            for (int c = 0; c != ncells; ++c) {
+                data[c * stride] = ((data[c * stride] & keep) | ((word >> (c * bits)) & mask));
+            }
+        }
+    }
+
+    /*! Stamps terminators, one cell at a time
+     */
+    template <int stride,
+              int bits>
+    void lsb_kernel<stride, bits>::terminate(unsigned char* data, const int, const int, const std::size_t ncells)
+    {
+        const unsigned int keep = ~((2u << bits) - 1);
+        for (std::size_t i = 0; i != ncells; ++i, data += stride) {
+            *data = ((*data & keep) | (1u << bits));
+        }
+    }
+
+    /*! Extracts message, one group at a time
+     */
+    template <int stride,
+              int bits>
+    std::size_t lsb_kernel<stride, bits>::extract(const unsigned char* data, const int, const int, const bool flag, char* buff, const std::size_t ncells)
+    {
+        // Message bits plus flag bit
+        const unsigned int test = ((2u << bits) - 1);
+
+        std::size_t i = 0;
+        for ( ; (i + group_cells) <= ncells; i += group_cells, data += (group_cells * stride), buff += group_bytes)
+        {
+            std::uint64_t word = 0;
+            for (int c = 0; c != group_cells; ++c)
+            {
+                const unsigned int cell = data[c * stride];
+
+                // Check for terminating character
+                if (flag && (cell & test) == (1u << bits)) {
+                    return (i + flush(buff, word, c)); // Reached end of message
+                }
+
+                word |= (static_cast<std::uint64_t>(cell & mask) << (c * bits));
+            }
+
+            for (int j = 0; j != group_bytes; ++j) {
+                buff[j] = static_cast<char>(word >> (8 * j));
+            }
+        }
+
+        // Trailing cells
+        std::uint64_t word = 0;
+        const int n = static_cast<int>(ncells - i);
+
+        for (int c = 0; c != n; ++c)
+        {
+            const unsigned int cell = data[c * stride];
+
+            // Check for terminating character
+            if (flag && (cell & test) == (1u << bits)) {
+                return (i + flush(buff, word, c)); // Reached end of message
+            }
+
+            word |= (static_cast<std::uint64_t>(cell & mask) << (c * bits));
+        }
+
+        return (i + flush(buff, word, n));
+    }
+}
+
+#endif
@@ -0,0 +1,229 @@
+/* lsb_sse2.cpp -- v1.0 -- SSE2 kernels used for embedding bits into, and extracting bits from, image cells
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstring>
+
+#include "cpu.hpp"
+#include "lsb.hpp"
+#include "lsb_kernel.hpp"
+
+#if defined(STEG_X86)
+
+// Everything below is built for SSE2, and only runs if the host supports it (see lsb_select)
+#pragma GCC target("sse2")
+
+#include <emmintrin.h>
+
+namespace {
+    /*! @class: lane constants for a block of 16 cells
+     * A block spans S vectors; only the lanes that hold a cell are modified
+     */
+    template <int S>
+    struct block {
+
+        __m128i bit[S];  // > mask of the message bit each cell takes, 0 for non-cell lanes
+        __m128i high[S]; // > 0xff if the cell takes its bit from the block's second byte
+        __m128i one[S];  // > 0x01 for cell lanes
+        __m128i keep[S]; // > clears the message (and flag) bits in cell lanes, 0xff otherwise
+        __m128i term[S]; // > the terminating character in cell lanes
+
+        inline block(const int bits, const bool flag) {
+
+            unsigned char bit_[S * 16], high_[S * 16], one_[S * 16], keep_[S * 16], term_[S * 16];
+            for (int b = 0; b != S * 16; ++b)
+            {
+                const int i = b / S;
+                const bool cell = (b % S) == 0;
+
+                bit_[b] = cell ? (1 << (i % 8)) : 0;
+                high_[b] = (i < 8) ? 0x00 : 0xff;
+                one_[b] = cell ? 0x01 : 0x00;
+                keep_[b] = cell ? ~(((flag ? 2 : 1) << bits) - 1) : 0xff;
+                term_[b] = cell ? (1 << bits) : 0x00;
+            }
+
+            for (int j = 0; j != S; ++j)
+            {
+                bit[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bit_ + 16 * j));
+                high[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high_ + 16 * j));
+                one[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(one_ + 16 * j));
+                keep[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keep_ + 16 * j));
+                term[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(term_ + 16 * j));
+            }
+        }
+    };
+
+    /*! Embeds two message bytes per step
+     */
+    template <int S>
+    void embed(unsigned char* data, const bool flag, const char* buff, const std::size_t size)
+    {
+        const block<S> blk(1, flag);
+
+        std::size_t i = 0;
+        for ( ; (i + 2) <= size; i += 2, data += (16 * S))
+        {
+            // Broadcast both bytes, then pick one per lane
+            const __m128i lo = _mm_set1_epi8(buff[i]);
+            const __m128i hi = _mm_set1_epi8(buff[i + 1]);
+
+            for (int j = 0; j != S; ++j)
+            {
+                const __m128i byte = _mm_or_si128(_mm_and_si128(blk.high[j], hi), _mm_andnot_si128(blk.high[j], lo));
+                // Expand bit to 0x00/0x01
+                const __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(byte, blk.bit[j]), blk.bit[j]), blk.one[j]);
+
+                __m128i* const ptr = reinterpret_cast<__m128i*>(data + (16 * j));
+                _mm_storeu_si128(ptr, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(ptr), blk.keep[j]), bits));
+            }
+        }
+
+        // Odd byte out
+        steg::lsb_kernel<S, 1>::embed(data, S, 1, flag, buff + i, size - i);
+    }
+
+    /*! Stamps sixteen terminators per step
+     */
+    template <int S>
+    void terminate(unsigned char* data, const int bits, const std::size_t ncells)
+    {
+        const block<S> blk(bits, true);
+
+        std::size_t i = 0;
+        for ( ; (i + 16) <= ncells; i += 16, data += (16 * S))
+        {
+            for (int j = 0; j != S; ++j)
+            {
+                __m128i* const ptr = reinterpret_cast<__m128i*>(data + (16 * j));
+                _mm_storeu_si128(ptr, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(ptr), blk.keep[j]), blk.term[j]));
+            }
+        }
+
+        // Trailing cells
+        steg::lsb_terminate_scalar(data, S, bits, ncells - i);
+    }
+
+    /*! Packs the cells of a block of 16 into a single vector
+     */
+    template <int S>
+    inline __m128i gather(const unsigned char* data);
+
+    template <>
+    inline __m128i gather<1>(const unsigned char* data) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    }
+
+    template <>
+    inline __m128i gather<2>(const unsigned char* data) {
+        const __m128i lo = _mm_set1_epi16(0x00ff);
+        return _mm_packus_epi16(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), lo),
+                                _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), lo));
+    }
+
+    template <>
+    inline __m128i gather<3>(const unsigned char* data) {
+        // No byte shuffle in SSE2
+        unsigned char cells[16];
+        for (int i = 0; i != 16; ++i) {
+            cells[i] = data[3 * i];
+        }
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(cells));
+    }
+
+    template <>
+    inline __m128i gather<4>(const unsigned char* data) {
+        const __m128i lo = _mm_set1_epi32(0x000000ff);
+        const __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), lo);
+        const __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), lo);
+        const __m128i c = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), lo);
+        const __m128i d = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), lo);
+        return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    }
+
+    /*! Extracts two message bytes per step
+     */
+    template <int S,
+              bool flag>
+    std::size_t extract(const unsigned char* data, char* buff, const std::size_t ncells)
+    {
+        const __m128i three = _mm_set1_epi8(0x03);
+        const __m128i two = _mm_set1_epi8(0x02);
+
+        std::size_t i = 0;
+        for ( ; (i + 16) <= ncells; i += 16, data += (16 * S), buff += 2)
+        {
+            const __m128i cells = gather<S>(data);
+
+            // Low-order bit of every cell, cell 0 first
+            const unsigned int bits = _mm_movemask_epi8(_mm_slli_epi16(cells, 7));
+            // Check for terminating character
+            const unsigned int term = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(cells, three), two));
+
+            if (flag && term != 0)
+            {
+                const int n = __builtin_ctz(term);
+                ::memcpy(buff, &bits, n / 8);
+                return (i + n); // Reached end of message
+            }
+
+            ::memcpy(buff, &bits, 2);
+        }
+
+        // Trailing cells
+        return i + steg::lsb_kernel<S, 1>::extract(data, S, 1, flag, buff, ncells - i);
+    }
+}
+
+/*! Embeds message, 16 cells per step
+ */
+void steg::lsb_embed_sse2(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size)
+{
+    switch (stride)
+    {
+        case 1: return embed<1>(data, flag, buff, size);
+        case 2: return embed<2>(data, flag, buff, size);
+        case 3: return embed<3>(data, flag, buff, size);
+        case 4: return embed<4>(data, flag, buff, size);
+
+        default: {
+            return lsb_embed_scalar(data, stride, bits, flag, buff, size);
+        }
+    }
+}
+
+/*! Stamps terminators, 16 cells per step
+ */
+void steg::lsb_terminate_sse2(unsigned char* data, const int stride, const int bits, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return terminate<1>(data, bits, ncells);
+        case 2: return terminate<2>(data, bits, ncells);
+        case 3: return terminate<3>(data, bits, ncells);
+        case 4: return terminate<4>(data, bits, ncells);
+
+        default: {
+            return lsb_terminate_scalar(data, stride, bits, ncells);
+        }
+    }
+}
+
+/*! Extracts message, 16 cells per step
+ */
+std::size_t steg::lsb_extract_sse2(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t ncells)
+{
+    switch (stride)
+    {
+        case 1: return flag ? extract<1, true>(data, buff, ncells) : extract<1, false>(data, buff, ncells);
+        case 2: return flag ? extract<2, true>(data, buff, ncells) : extract<2, false>(data, buff, ncells);
+        case 3: return flag ? extract<3, true>(data, buff, ncells) : extract<3, false>(data, buff, ncells);
+        case 4: return flag ? extract<4, true>(data, buff, ncells) : extract<4, false>(data, buff, ncells);
+
+        default: {
+            return lsb_extract_scalar(data, stride, bits, flag, buff, ncells);
+        }
+    }
+}
+
+#endif
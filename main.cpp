@@ -1,10 +1,12 @@
 /* main.cpp -- v1.0 -- program entry point
    Author: Sam Y. 2021 */
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 #include <cctype>
+#include <cstdlib>
 #include <memory>
 
 #include <getopt.h>
@@ -13,8 +15,14 @@
 #include "base64.hpp"
 #include "block_encoder.hpp"
 #include "block_decoder.hpp"
+#include "cipher_ctl.hpp"
+#include "compression.hpp"
 #include "error.hpp"
 #include "image.hpp"
+#include "layout.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include "tiled_image.hpp"
 
 namespace {
     /*! @class: writes to file
@@ -54,6 +62,9 @@ namespace {
         // Encapsulated file descriptor
         FILE* fd_;
 
+        // Nothing read yet
+        bool first_;
+
     public:
 
         inline ~input_stream() {
@@ -64,14 +75,15 @@ namespace {
         }
 
         /// ctor.
-        inline input_stream() : fd_(stdin) {  }
-        inline explicit input_stream(input_stream&& other) : fd_(other.fd_) {
+        inline input_stream() : fd_(stdin), first_(true) {  }
+        inline explicit input_stream(input_stream&& other) : fd_(other.fd_), first_(other.first_) {
             other.fd_ = nullptr;
         }
 
         /// assignment
         inline input_stream& operator()(input_stream&& other) {
             fd_ = other.fd_;
+            first_ = other.first_;
             other.fd_ = nullptr;
             return *this;
         }
@@ -100,10 +112,11 @@ namespace {
                 return 0;
             }
 
-            // Read raw data
+            // Read raw data; messages read a chunk at a time only lose the newline of the first chunk
             if ((size = std::fread(buff, sizeof(char), size, fd_)))
-                if (fd_ == stdin)
+                if (fd_ == stdin && first_)
                     buff[strcspn(buff, "\n")] = 0; // Remove trailing newline (stdin has different rules)
+            first_ = false;
             return size;
         }
     };
@@ -146,43 +159,109 @@ namespace {
     inline void print_usage(const char* app)
     {
         printf("---------------------------------------------------------------------------------\n");
-        printf("Usage: %s {--encode|--decode|-h}\n"
+        printf("Usage: %s {--encode|--decode|--capacity|-h}\n"
                "   -f<encoded-image-source>\n"
                "  [-o<output-file>]\n"
                "  [-t<output-file-type>]\n"
                "   -k<crypt-key-file>\n"
                "   -v<init-vec-file>\n"
+               "  [-m<cipher-mode>]\n"
                "  [-i<message-file>]\n"
+               "  [-n<bits-per-channel>]\n"
+               "  [-a]\n"
+               "  [-s]\n"
+               "  [-j<threads>]\n"
+               "  [-z<compression>]\n"
                "  [-b]\n"
+               "  [--legacy]\n"
+               "  [--tiled]\n"
                , app);
 
         printf("\n");
-        printf("  %s\n  %s\n  %s\n",
+        printf("  %s\n  %s\n  %s\n  %s\n",
                "--encode                     Encoding mode",
                "--decode                     Decoding mode",
+               "--capacity                   Capacity mode",
                "--help (-h)                  Prints this message");
 
         printf("\n");
         printf("------------Encode Mode----------------------------------------------------------\n");
         printf("\t%s\n\n"
                "\t%s\n\t%s\n\n"
-               "\t%s\n\t%s\n\n"
+               "\t%s\n\t%s\n\t%s\n\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n\n"
                "\t%s\n"
                "\t%s\n",
 
                "-f<image-source>           Source file for image that the message will be\n\t"
-               "                           encoded to",
+               "                           encoded to; - reads a PNM or PAM image from\n\t"
+               "                           stdin (use -i for the message)",
 
-               "-o<output-file>            Outputs to this file",
-               "-t<output-file-type>       Accepted types: png, bmp, or tga",
+               "-o<output-file>            Outputs to this file; - writes a PNM or PAM\n\t"
+               "                           image to stdout",
+               "-t<output-file-type>       Accepted types: png, bmp, tga, qoi, pnm (or\n\t"
+               "                           ppm, pgm; PAM if the image has alpha), or pam.\n\t"
+               "                           QOI encodes and decodes much faster than PNG;\n\t"
+               "                           PNM and PAM rows are stored as they are. Only\n\t"
+               "                           PNG, PNM and PAM keep 16-bit samples",
 
                "-k<crypt-key-file>         AES cryptographic key file",
                "-v<init-vec-file>          Initialization vector file",
+               "-m<cipher-mode>            ctr, which encrypts the message a chunk at a\n\t"
+               "                           time, unpadded, from a counter no other message\n\t"
+               "                           starts from (its header records a random nonce\n\t"
+               "                           the counter is derived from); gcm, which also\n\t"
+               "                           derives its IV from the nonce, and authenticates\n\t"
+               "                           the message, so that decoding rejects a wrong\n\t"
+               "                           key at once and never outputs an altered message\n\t"
+               "                           (32 bytes longer); or ecb, which pads it to 128\n\t"
+               "                           bytes, like older versions do (defaults to ctr).\n\t"
+               "                           Images encoded by older versions have no header,\n\t"
+               "                           and decode with --legacy -m ecb, not -m ecb alone",
 
                "-i<message-file>           Source file of message; if left unspecified,\n\t"
                "                           source is the terminal (stdin)",
 
-               "-b                         Encodes the encrypted output as a base64 string");
+               "-n<bits-per-channel>       No. of low-order bits of each channel that carry\n\t"
+               "                           the message, 1 to 4 (defaults to 1); 1 to 8 for\n\t"
+               "                           16-bit PNG, PNM and PAM images (7 with --legacy)",
+               "-a                         Spreads the message over all channels of each\n\t"
+               "                           pixel, instead of the first channel only; grey\n\t"
+               "                           images cannot then be saved as BMP or QOI",
+               "-s                         Scatters the message over the image in a\n\t"
+               "                           key-derived order, instead of from the first\n\t"
+               "                           pixel on",
+               "-j<threads>                No. of threads that encrypt (ctr and ecb) and\n\t"
+               "                           embed the message and compress zlib PNG output,\n\t"
+               "                           0 for one per core (defaults to 1)",
+               "-z<compression>            PNG compression: stb, store (none), or a zlib\n\t"
+               "                           level from 0 to 9 (defaults to stb; zlib level\n\t"
+               "                           6 in tiled mode)",
+
+               "-b                         Encodes the encrypted output as a base64 string",
+
+               "--legacy                   Ends the message with terminating characters\n\t"
+               "                           instead of a header, like older versions do;\n\t"
+               "                           every pixel of the image is modified. There is\n\t"
+               "                           no header to record a nonce in either, so ctr\n\t"
+               "                           and gcm need a new IV file for each message",
+               "--tiled                    Reads, embeds into and writes the image a band\n\t"
+               "                           of rows at a time, to bound memory use; PNG\n\t"
+               "                           (not interlaced), BMP, TGA, QOI, PNM and PAM\n\t"
+               "                           images only. Uncompressed BMP and TGA images,\n\t"
+               "                           and PNM and PAM files, saved as the same type\n\t"
+               "                           are copied, and only the rows that carry the\n\t"
+               "                           message are rewritten. With - for -f and -o,\n\t"
+               "                           runs as a pipe stage. The encrypted message is\n\t"
+               "                           still held in memory until the image is written,\n\t"
+               "                           since the header before it needs its size and\n\t"
+               "                           checksum");
 
         printf("\n");
         printf("------------Decode Mode----------------------------------------------------------\n");
@@ -190,9 +269,17 @@ namespace {
                "\t%s\n\n"
                "\t%s\n\n"
                "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
                "\t%s\n",
 
-               "-f<encoded-image>          Source file of encoded message",
+               "-f<encoded-image>          Source file of encoded message; - reads a PNM\n\t"
+               "                           or PAM image from stdin",
 
                "-o<output-file>            Outputs to this file; if left unspecified,\n\t"
                "                           outpts to the terminal (stdout)",
@@ -200,39 +287,88 @@ namespace {
                "-k<crypt-key-file>         AES cryptographic key file",
 
                "-v<init-vec-file>          Initialization vector file",
+               "-m<cipher-mode>            Read from the image; required if the message was\n\t"
+               "                           encoded with -m and --legacy. Images encoded by\n\t"
+               "                           older versions need --legacy -m ecb",
+               "-n<bits-per-channel>       Required if the message was encoded with -n",
+               "-a                         Required if the message was encoded with -a",
+               "-s                         Required if the message was encoded with -s",
+               "-j<threads>                No. of threads that extract and decrypt (ctr and\n\t"
+               "                           ecb) the message, 0 for one per core (defaults\n\t"
+               "                           to 1)",
                "-b                         Required if the encryption output was a base64\n\t"
-               "                           string");
+               "                           string",
+               "--legacy                   Required if the message was encoded with\n\t"
+               "                           --legacy; images encoded by older versions,\n\t"
+               "                           which have no header, need --legacy -m ecb",
+               "--tiled                    Reads the image a band of rows at a time; done\n\t"
+               "                           anyway for images tiled mode can read, unless\n\t"
+               "                           the message is scattered (-s), and decoding\n\t"
+               "                           stops after the last row of the message");
+
+        printf("\n");
+        printf("------------Capacity Mode--------------------------------------------------------\n");
+        printf("\t%s\n\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n"
+               "\t%s\n",
+
+               "-f<image-source>           Image file; prints the size, in bytes, of the\n\t"
+               "                           largest message it can carry, from its header\n\t"
+               "                           alone",
+
+               "-m<cipher-mode>            As for encode mode",
+               "-n<bits-per-channel>       As for encode mode",
+               "-a                         As for encode mode",
+               "-s                         As for encode mode",
+               "-b                         As for encode mode",
+               "--legacy                   As for encode mode");
     }
 }
 
 namespace {
 
     // @bag
+    template <typename I>
     struct encode_io {
 
-        // Cryptographic vars
+        // Cryptographic vars; the nonce is nullptr if the message has no header to record it
         std::unique_ptr<char[]> key;
         std::unique_ptr<char[]> vec;
+        std::unique_ptr<char[]> nonce;
+        steg::cipher::mode_type mode;
+
+        // Worker threads, or nullptr
+        steg::thread_pool* pool;
 
         // Encoded image output variables
         char* outputPath;
         steg::image::image_type outputType;
 
         // Encoded image output
-        steg::image output;
+        I output;
         // Message input
         input_stream input;
     };
 
     // @bag
+    template <typename I>
     struct decode_io {
 
-        // Cryptographic vars
+        // Cryptographic vars; the nonce, owned by input, is nullptr if its header records none
         std::unique_ptr<char[]> key;
         std::unique_ptr<char[]> vec;
+        const char* nonce;
+        steg::cipher::mode_type mode;
+
+        // Worker threads, or nullptr
+        steg::thread_pool* pool;
 
         // Image input
-        steg::image input;
+        I input;
         // Input message
         output_stream output;
     };
@@ -240,14 +376,15 @@ namespace {
 
 namespace {
     // Helper: encodes text to image
-    template <typename T>
-    int encode(encode_io& io)
+    template <typename T,
+              typename I>
+    int encode(encode_io<I>& io)
     {
         // Create encoder
-        std::unique_ptr<T> encoder(T::create((io.key).get(), (io.vec).get()));
+        std::unique_ptr<T> encoder(T::create((io.key).get(), (io.vec).get(), io.mode, (io.nonce).get()));
 
         // Encrypt the message
-        if (encoder.get() && encoder->run(io.input, io.output))
+        if (encoder.get() && (encoder->set_pool(io.pool), encoder->run(io.input, io.output)))
         {
             // Save the image
             if ((io.output).save(io.outputPath, io.outputType)) {
@@ -260,21 +397,169 @@ namespace {
     }
 
     // Helper: decodes text from image
-    template <typename T>
-    int decode(decode_io& io)
+    template <typename T,
+              typename I>
+    int decode(decode_io<I>& io)
     {
         // Create encoder
-        std::unique_ptr<T> decoder(T::create((io.key).get(), (io.vec).get()));
+        std::unique_ptr<T> decoder(T::create((io.key).get(), (io.vec).get(), io.mode, io.nonce));
 
         if (decoder.get() == nullptr) {
             return 1; // Error code
         }
 
+        decoder->set_pool(io.pool);
+
         // Decrypt the message & return
         return decoder->run(io.input, io.output) ? 0 : 1;
     }
 }
 
+namespace {
+
+    // @bag
+    struct options {
+
+        // Image source file
+        char* imagePath;
+
+        // Output file
+        char* outputPath;
+        steg::image::image_type outputType;
+
+        // Input file
+        char* inputPath;
+
+        // Message layout
+        steg::layout lay;
+        // Base64
+        int b64;
+
+        // Block cipher mode, and whether -m gave it
+        steg::cipher::mode_type mode;
+        bool modeSet;
+
+        // Worker threads, or nullptr
+        steg::thread_pool* pool;
+
+        // PNG compression
+        steg::compression comp;
+    };
+
+    // Helper: loads the image and the message, then encodes; I is the image class
+    template <typename I>
+    int encode_image(const options& opts, char* key, char* vec)
+    {
+        encode_io<I> io;
+        (io.output).set_pool(opts.pool);
+        (io.output).set_compression(opts.comp);
+
+        (io.key).reset(key);
+        (io.vec).reset(vec);
+        io.mode = opts.mode;
+        io.pool = opts.pool;
+
+        // Each message gets a nonce of its own, recorded in the header; --legacy layouts have no header to keep it in
+        if (!opts.lay.terminated)
+        {
+            (io.nonce).reset(new char[steg::cipher_nonce_size]);
+            steg::cipher_nonce((io.nonce).get());
+            (io.output).set_cipher(opts.mode, (io.nonce).get());
+        }
+
+        // Plain message input;
+        // If file specified, try to open it; otherwise, we'll use stdin
+        if (opts.inputPath != nullptr)
+        {
+            if (!(io.input).open(opts.inputPath)) {
+                // Handle error
+                return (print_file_error(opts.inputPath), 1);
+            }
+
+            // The message size is known up front; check it fits before the image is decoded
+            const std::size_t size = (io.input).size();
+            std::size_t capacity;
+
+            // An image on stdin can only be read once
+            if (size != 0 && ::strcmp(opts.imagePath, "-") != 0)
+            {
+                // The image cannot be loaded either, or cannot take the bits per channel
+                if (!steg::image::capacity(opts.imagePath, opts.lay, capacity)) {
+                    return 1;
+                }
+
+                const std::size_t needed = (opts.b64 == true) ?
+                                           steg::block_encoder<true, basic_allocator>::encoded_size(size, opts.mode) :
+                                           steg::block_encoder<false, basic_allocator>::encoded_size(size, opts.mode);
+
+                if (needed > capacity) {
+                    return ((steg::error::get())->log("Error: source image is too small to encode entire message, exiting"), 1);
+                }
+            }
+        }
+
+        // Load encoded image source
+        if (!(io.output).open(opts.imagePath, opts.lay)) {
+            // Handle error
+            return (print_file_error(opts.imagePath), 1);
+        }
+
+        // Assign output file variables
+        io.outputPath = opts.outputPath;
+        io.outputType = opts.outputType;
+
+        return (opts.b64 == true ?
+                encode<steg::block_encoder<true, basic_allocator>, I> :
+                encode<steg::block_encoder<false, basic_allocator>, I>)(io);
+    }
+
+    // Helper: loads the image, then decodes; I is the image class
+    template <typename I>
+    int decode_image(const options& opts, char* key, char* vec)
+    {
+        decode_io<I> io;
+        (io.input).set_pool(opts.pool);
+        (io.key).reset(key);
+        (io.vec).reset(vec);
+        io.mode = opts.mode;
+        io.pool = opts.pool;
+
+        // Load source image
+        if (!(io.input).open(opts.imagePath, opts.lay)) {
+            // Handle error
+            return (print_file_error(opts.imagePath), 1);
+        }
+
+        // The header records the cipher mode, unless the image has none or predates it; -m may only confirm it
+        const int recorded = (io.input).cipher_mode();
+        if (recorded != -1)
+        {
+            if (opts.modeSet && recorded != opts.mode) {
+                const char* const names[] = { "ecb", "ctr", "gcm" };
+                return ((steg::error::get())->log("Error: the message was encrypted with -m ", names[recorded], ", exiting"), 1);
+            }
+
+            io.mode = static_cast<steg::cipher::mode_type>(recorded);
+        }
+
+        io.nonce = (io.input).cipher_nonce();
+
+        // Plain message output;
+        // If file specified, try to open it;
+        if (opts.outputPath != nullptr)
+        {
+            if (!(io.output).open(opts.outputPath)) {
+                // Handle error
+                return (print_file_error(opts.outputPath), 1);
+            }
+        }
+
+        return (opts.b64 == true ?
+                decode<steg::block_decoder<true, basic_allocator>, I> :
+                decode<steg::block_decoder<false, basic_allocator>, I>)(io);
+    }
+}
+
 int main(int argc, char** argv)
 {
     // Image source file
@@ -296,19 +581,38 @@ int main(int argc, char** argv)
         { "help",   no_argument, nullptr, 0 },
         { "encode", no_argument, nullptr, 0 },
         { "decode", no_argument, nullptr, 0 },
+        { "legacy", no_argument, nullptr, 0 },
+        { "tiled",  no_argument, nullptr, 0 },
+        { "capacity", no_argument, nullptr, 0 },
         { nullptr, 0, nullptr, 0 },
     };
 
     // Null   = 0
     // Encode = 1
     // Decode = 2
+    // Capacity = 3
     int mode = 0;
     // Base64
     int b64 = 0;
+    // Process the image a band of rows at a time
+    bool tiled = false;
+
+    // Message layout
+    steg::layout lay = { 1, false, false, false, 0 };
+
+    // No. of threads, 0 for one per core
+    int nthreads = 1;
+
+    // PNG compression
+    steg::compression comp = { steg::compression::STB, 6 };
+
+    // Block cipher mode
+    steg::cipher::mode_type cipherMode = steg::cipher::CTR;
+    bool cipherModeSet = false;
 
     // Parse command line options...
     int opt, optindex;
-    while ((opt = getopt_long(argc, argv, "-f:t:o:k:v:i:bh", longOptions, &optindex)) != -1)
+    while ((opt = getopt_long(argc, argv, "-f:t:o:k:v:i:n:j:z:m:absh", longOptions, &optindex)) != -1)
     {
         switch (opt)
         {
@@ -354,6 +658,80 @@ int main(int argc, char** argv)
                 break;
             }
 
+            // Bits per channel
+            case 'n':
+            {
+                lay.bits = ::atoi(optarg);
+                break;
+            }
+
+            // Use all channels
+            case 'a':
+            {
+                lay.allChanns = true;
+                break;
+            }
+
+            // Scatter over the image
+            case 's':
+            {
+                lay.scattered = true;
+                break;
+            }
+
+            // No. of threads
+            case 'j':
+            {
+                nthreads = ::atoi(optarg);
+                break;
+            }
+
+            // PNG compression
+            case 'z':
+            {
+                if (::strcmp(optarg, "stb") == 0) {
+                    comp = { steg::compression::STB, 6 };
+                }
+
+                else if (::strcmp(optarg, "store") == 0) {
+                    comp = { steg::compression::STORE, 0 };
+                }
+
+                else if (::isdigit(optarg[0]) && optarg[1] == '\0') {
+                    comp = { steg::compression::ZLIB, optarg[0] - '0' };
+                }
+
+                else {
+                    comp.level = -1;
+                }
+
+                break;
+            }
+
+            // Block cipher mode
+            case 'm':
+            {
+                cipherModeSet = true;
+
+                if (::strcmp(optarg, "ctr") == 0) {
+                    cipherMode = steg::cipher::CTR;
+                }
+
+                else if (::strcmp(optarg, "gcm") == 0) {
+                    cipherMode = steg::cipher::GCM;
+                }
+
+                else if (::strcmp(optarg, "ecb") == 0) {
+                    cipherMode = steg::cipher::ECB;
+                }
+
+                else {
+                    return ((steg::error::get())->log("Error: cipher mode must be ctr, gcm or ecb (use -m), exiting"), 1);
+                }
+
+                break;
+            }
+
             // Use base 64 encoding
             case 'b':
             {
@@ -388,7 +766,7 @@ int main(int argc, char** argv)
                     {
                         if (mode != 0)
                         {
-                            return ((steg::error::get())->log("Error: either select encode or decode, I can't do both"),
+                            return ((steg::error::get())->log("Error: select only one of encode, decode, or capacity"),
                                     print_usage(argv[0]),
                                     1);
                         }
@@ -402,7 +780,7 @@ int main(int argc, char** argv)
                     {
                         if (mode != 0)
                         {
-                            return ((steg::error::get())->log("Error: either select encode or decode, I can't do both"),
+                            return ((steg::error::get())->log("Error: select only one of encode, decode, or capacity"),
                                     print_usage(argv[0]),
                                     1);
                         }
@@ -410,6 +788,34 @@ int main(int argc, char** argv)
                         mode = 2;
                         break;
                     }
+
+                    // Terminated layout
+                    case 3:
+                    {
+                        lay.terminated = true;
+                        break;
+                    }
+
+                    // Tiled mode
+                    case 4:
+                    {
+                        tiled = true;
+                        break;
+                    }
+
+                    // Capacity mode
+                    case 5:
+                    {
+                        if (mode != 0)
+                        {
+                            return ((steg::error::get())->log("Error: select only one of encode, decode, or capacity"),
+                                    print_usage(argv[0]),
+                                    1);
+                        }
+
+                        mode = 3;
+                        break;
+                    }
                 }
             }
         }
@@ -418,7 +824,7 @@ int main(int argc, char** argv)
     // Ensure all necessary parameters specified; exit otherwise...
     if (mode == 0)
     {
-        return ((steg::error::get())->log("Error: you forgot to select the program mode; either select encode (--encode) or decode (--decode)"),
+        return ((steg::error::get())->log("Error: you forgot to select the program mode; either select encode (--encode), decode (--decode), or capacity (--capacity)"),
                 print_usage(argv[0]),
                 1);
     }
@@ -427,6 +833,25 @@ int main(int argc, char** argv)
         return ((steg::error::get())->log("Error: no image file specified (one of bmp, bmp, or tga formats), exiting"), 1);
     }
 
+    // The image decides whether more than 4 bits fit, once loaded
+    if (lay.bits < 1 || lay.bits > 8) {
+        return ((steg::error::get())->log("Error: bits per channel must be between 1 and 8 (use -n), exiting"), 1);
+    }
+
+    // Only the image header is read; no key is needed
+    if (mode == 3)
+    {
+        std::size_t size;
+        if (!steg::image::capacity(imagePath, lay, size)) {
+            return 1;
+        }
+
+        printf("%zu\n", b64 ?
+               steg::block_encoder<true, basic_allocator>::max_message_size(size, cipherMode) :
+               steg::block_encoder<false, basic_allocator>::max_message_size(size, cipherMode));
+        return 0;
+    }
+
     if (keyFilePath == nullptr) {
         return ((steg::error::get())->log("Error: no encryption key specified (use -k), exiting"), 1);
     }
@@ -439,6 +864,34 @@ int main(int argc, char** argv)
         return ((steg::error::get())->log("Error: no output file specified (use -o), exiting"), 1);
     }
 
+    // An image on stdin ("-")
+    const bool piped = (::strcmp(imagePath, "-") == 0);
+
+    if (piped && mode == 1 && inputPath == nullptr) {
+        return ((steg::error::get())->log("Error: the image and the message cannot both come from stdin (use -i), exiting"), 1);
+    }
+
+    if (tiled && lay.scattered) {
+        return ((steg::error::get())->log("Error: the message cannot be scattered (-s) in tiled mode (--tiled), exiting"), 1);
+    }
+
+    if (nthreads < 0) {
+        return ((steg::error::get())->log("Error: no. of threads cannot be negative (use -j), exiting"), 1);
+    }
+
+    if (comp.level < 0) {
+        return ((steg::error::get())->log("Error: compression must be stb, store, or a level from 0 to 9 (use -z), exiting"), 1);
+    }
+
+    // A message laid out from the first pixel on is extracted a band of rows at a time, and
+    // the image is only decoded as far as the last row that carries it
+    const bool streamed = tiled || (mode == 2 && !lay.scattered && (piped || steg::tiled_image::readable(imagePath)));
+
+    // The whole image is loaded; start reading it while the key and the workers are set up
+    if (!streamed) {
+        steg::mapped_file::prefetch(imagePath);
+    }
+
     // Open file
     input_stream keyStream;
     input_stream vecStream;
@@ -468,99 +921,90 @@ int main(int argc, char** argv)
     keyStream.read(key, keySize);
     vecStream.read(vec, vecSize);
 
-    // Go...
-    switch (mode)
-    {
-        // Encrypt
-        case 1:
-        {
-            encode_io io;
-
-            // Load encoded image source
-            if (!(io.output).open(imagePath)) {
-                // Handle error
-                return (print_file_error(imagePath), 1);
-            }
+    // Visiting order of cells, derived from the key
+    if (lay.scattered) {
+        lay.seed = steg::cipher_seed(key, "steg scatter");
+    }
 
-            (io.key).reset(key);
-            (io.vec).reset(vec);
+    // Worker threads, shared by every stage
+    std::unique_ptr<steg::thread_pool> pool;
 
-            // Plain message input;
-            // If file specified, try to open it; otherwise, we'll use stdin
-            if (inputPath != nullptr)
-            {
-                if (!(io.input).open(inputPath)) {
-                    // Handle error
-                    return (print_file_error(inputPath), 1);
-                }
-            }
+    if (nthreads == 0) {
+        nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
 
-            // Assign output file variables
-            io.outputPath = outputPath;
-            io.outputType = [outputType] {
+    if (nthreads > 1) {
+        pool.reset(new steg::thread_pool(nthreads));
+    }
 
-                // Use PNG if not unspecified
-                if (outputType == nullptr) {
-                    return steg::image::image_type::PNG;
-                }
+    // Go...
+    options opts;
+    opts.imagePath = imagePath;
+    opts.outputPath = outputPath;
+    opts.inputPath = inputPath;
+    opts.lay = lay;
+    opts.b64 = b64;
+    opts.mode = cipherMode;
+    opts.modeSet = cipherModeSet;
+    opts.pool = pool.get();
+    opts.comp = comp;
+
+    // Assign output file variables
+    opts.outputType = [outputType] {
+
+        // Use PNG if not unspecified
+        if (outputType == nullptr) {
+            return steg::image::image_type::PNG;
+        }
 
-                const std::size_t len = ::strlen(outputType);
+        const std::size_t len = ::strlen(outputType);
 
-                std::unique_ptr<char[]> type(new char[len + 1]);
-                ::memset(type.get(), 0, len + 1);
+        std::unique_ptr<char[]> type(new char[len + 1]);
+        ::memset(type.get(), 0, len + 1);
 
-                for (std::size_t i = 0; i != len; ++i) {
-                    type[i] = ::tolower(outputType[i]);
-                }
+        for (std::size_t i = 0; i != len; ++i) {
+            type[i] = ::tolower(outputType[i]);
+        }
 
-                if (::strcmp(type.get(), "png") == 0) {
-                    return steg::image::image_type::PNG;
-                }
+        if (::strcmp(type.get(), "png") == 0) {
+            return steg::image::image_type::PNG;
+        }
 
-                else if (::strcmp(type.get(), "bmp") == 0) {
-                    return steg::image::image_type::BMP;
-                }
+        else if (::strcmp(type.get(), "bmp") == 0) {
+            return steg::image::image_type::BMP;
+        }
 
-                else if (::strcmp(type.get(), "tga") == 0) {
-                    return steg::image::image_type::TGA;
-                }
+        else if (::strcmp(type.get(), "tga") == 0) {
+            return steg::image::image_type::TGA;
+        }
 
-                else {
-                    return steg::image::image_type::PNG;
-                }
-            }();
+        else if (::strcmp(type.get(), "qoi") == 0) {
+            return steg::image::image_type::QOI;
+        }
 
-            return (b64 == true ?
-                    encode<steg::block_encoder<true, basic_allocator> > :
-                    encode<steg::block_encoder<false, basic_allocator> >)(io);
+        else if (::strcmp(type.get(), "pnm") == 0 || ::strcmp(type.get(), "ppm") == 0 || ::strcmp(type.get(), "pgm") == 0) {
+            return steg::image::image_type::PNM;
         }
 
-        // Decrypt
-        case 2:
-        {
-            decode_io io;
-            (io.key).reset(key);
-            (io.vec).reset(vec);
+        else if (::strcmp(type.get(), "pam") == 0) {
+            return steg::image::image_type::PAM;
+        }
 
-            // Load source image
-            if (!(io.input).open(imagePath)) {
-                // Handle error
-                return (print_file_error(imagePath), 1);
-            }
+        else {
+            return steg::image::image_type::PNG;
+        }
+    }();
 
-            // Plain message output;
-            // If file specified, try to open it;
-            if (outputPath != nullptr)
-            {
-                if (!(io.output).open(outputPath)) {
-                    // Handle error
-                    return (print_file_error(outputPath), 1);
-                }
-            }
+    switch (mode)
+    {
+        // Encrypt
+        case 1: {
+            return tiled ? encode_image<steg::tiled_image>(opts, key, vec) : encode_image<steg::image>(opts, key, vec);
+        }
 
-            return (b64 == true ?
-                    decode<steg::block_decoder<true, basic_allocator> > :
-                    decode<steg::block_decoder<false, basic_allocator> >)(io);
+        // Decrypt
+        case 2: {
+            return streamed ? decode_image<steg::tiled_image>(opts, key, vec) : decode_image<steg::image>(opts, key, vec);
         }
 
         default: {
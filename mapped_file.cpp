@@ -0,0 +1,174 @@
+/* mapped_file.cpp -- v1.0 -- maps a file into memory, copies files
+   Author: Sam Y. 2021 */
+
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+// copy_file_range() came with glibc 2.27
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 27)
+#define STEG_COPY_FILE_RANGE 1
+#endif
+#endif
+
+#include "mapped_file.hpp"
+
+namespace {
+    /*! Helper
+     * Copies the rest of a file with the kernel's help, or through a buffer
+     */
+    bool copy_bytes(const int in, const int out, std::size_t size)
+    {
+#if defined(STEG_COPY_FILE_RANGE)
+        // No trip through user space; may not work across file systems
+        while (size != 0)
+        {
+            const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, size, 0);
+            if (n <= 0) {
+                break;
+            }
+
+            size -= static_cast<std::size_t>(n);
+        }
+
+        if (size == 0) {
+            return true;
+        }
+#endif
+
+        std::vector<char> buff(1024 * 1024);
+        while (size != 0)
+        {
+            const ssize_t n = ::read(in, buff.data(), buff.size());
+            if (n <= 0 || ::write(out, buff.data(), static_cast<std::size_t>(n)) != n) {
+                return false;
+            }
+
+            size -= static_cast<std::size_t>(n);
+        }
+
+        return true;
+    }
+}
+
+/*! dtor.
+ */
+steg::mapped_file::~mapped_file()
+{
+    close();
+}
+
+/*! ctor.
+ */
+steg::mapped_file::mapped_file() : data_(nullptr)
+                                 , size_(0) {  }
+
+/*! Maps a file
+ */
+bool steg::mapped_file::open(const char* path, const bool writable)
+{
+    // Return if a file is already mapped
+    if (data_ != nullptr || path == nullptr) {
+        return false;
+    }
+
+    const int fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        return (::close(fd), false);
+    }
+
+    void* const data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+    // The mapping outlives the descriptor
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    data_ = static_cast<unsigned char*>(data);
+    size_ = static_cast<std::size_t>(st.st_size);
+    return true;
+}
+
+/*! Unmaps the file
+ */
+bool steg::mapped_file::close()
+{
+    if (data_ == nullptr) {
+        return true;
+    }
+
+    const bool ret = (::munmap(data_, size_) == 0);
+    data_ = nullptr;
+    size_ = 0;
+    return ret;
+}
+
+/*! Access hints
+ */
+void steg::mapped_file::sequential() const
+{
+    if (data_ != nullptr)
+    {
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+        ::madvise(data_, size_, MADV_WILLNEED);
+    }
+}
+
+/*! Copies a file
+ */
+bool steg::mapped_file::copy(const char* from, const char* to)
+{
+    const int in = ::open(from, O_RDONLY);
+    if (in < 0) {
+        return false;
+    }
+
+    struct stat st;
+    const int out = (::fstat(in, &st) == 0) ? ::open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666) : -1;
+    if (out < 0) {
+        return (::close(in), false);
+    }
+
+    bool ret = false;
+
+#if defined(FICLONE)
+    // Copy on write, no data is copied at all
+    ret = (::ioctl(out, FICLONE, in) == 0);
+#endif
+
+    if (!ret) {
+        ret = copy_bytes(in, out, static_cast<std::size_t>(st.st_size));
+    }
+
+    ::close(in);
+    return (::close(out) == 0) && ret;
+}
+
+/*! Prefetches a file
+ */
+void steg::mapped_file::prefetch(const char* path)
+{
+    const int fd = (path != nullptr) ? ::open(path, O_RDONLY) : -1;
+    if (fd < 0) {
+        return;
+    }
+
+    // Reads go on after the descriptor is closed
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    ::close(fd);
+}
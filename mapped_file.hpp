@@ -0,0 +1,66 @@
+/* mapped_file.hpp -- v1.0 -- maps a file into memory, copies files
+   Author: Sam Y. 2021 */
+
+#ifndef _MAPPED_FILE_HPP
+#define _MAPPED_FILE_HPP
+
+#include <cstddef>
+
+namespace steg {
+    /// @class mapped_file
+    class mapped_file {
+    public:
+
+        /// dtor.
+        ~mapped_file();
+
+        /// ctor.
+        mapped_file();
+
+        /// Maps a whole file
+        /// @param path        file path
+        /// @param writable    changes to the mapping go to the file
+        /// @return            true on success, false otherwise
+        bool open(const char* path, const bool writable);
+
+        /// Unmaps the file
+        /// @return    true on success, false otherwise
+        bool close();
+
+        /// Hints that the mapping will be read once, front to back, and soon
+        void sequential() const;
+
+        /// @return    the mapped bytes, or nullptr if no file is mapped
+        inline unsigned char* data() const {
+            return data_;
+        }
+
+        /// @return    the size of the mapped file
+        inline std::size_t size() const {
+            return size_;
+        }
+
+        /// Copies a file; the copy shares the source's blocks if the file system can, or
+        /// is copied by the kernel if it cannot
+        /// @param from    source file path
+        /// @param to      destination file path, replaced if it exists
+        /// @return        true on success, false otherwise
+        static bool copy(const char* from, const char* to);
+
+        /// Starts reading a file into the page cache, without waiting for it
+        /// @param path    file path
+        static void prefetch(const char* path);
+
+    private:
+
+        // Non-copyable
+        explicit mapped_file(mapped_file&) = delete;
+        explicit mapped_file(const mapped_file&) = delete;
+
+        // Mapped bytes, and their no.
+        unsigned char* data_;
+        std::size_t size_;
+    };
+}
+
+#endif
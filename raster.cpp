@@ -0,0 +1,212 @@
+/* raster.cpp -- v1.0 -- reads and writes images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "error.hpp"
+#include "raster.hpp"
+
+/*! dtor.
+ */
+steg::raster_reader::~raster_reader()
+{
+    if (fd_ != nullptr) {
+        std::fclose(fd_);
+    }
+}
+
+/*! ctor.
+ */
+steg::raster_reader::raster_reader(std::FILE* fd) : fd_(fd)
+                                                  , w_(0)
+                                                  , h_(0)
+                                                  , nchanns_(0)
+                                                  , depth_(1)
+                                                  , bottomUp_(false) {  }
+
+/*! Factory method
+ */
+steg::raster_reader* steg::raster_reader::open(const char* path)
+{
+    // Pipes cannot be sniffed and rewound; only PNM and PAM images come through them
+    if (::strcmp(path, "-") == 0)
+    {
+        raster_reader* reader = pnm_reader(stdin);
+        if (reader == nullptr) {
+            (error::get())->log("Error: unable to load image from stdin, only binary PGM, PPM and PAM images are supported");
+        }
+
+        return reader;
+    }
+
+    std::FILE* fd;
+    if ((fd = std::fopen(path, "rb")) == nullptr) {
+        return ((error::get())->log("Error: unable to load image ", path), nullptr);
+    }
+
+    raster_reader* reader = sniff(fd);
+    if (reader == nullptr) {
+        (error::get())->log("Error: unable to load image ", path, " in tiled mode, only non-interlaced PNG, uncompressed BMP, TGA, QOI, and binary PNM and PAM images are supported");
+    }
+
+    return reader;
+}
+
+/*! Factory method, quiet
+ */
+steg::raster_reader* steg::raster_reader::probe(const char* path)
+{
+    if (::strcmp(path, "-") == 0) {
+        return pnm_reader(stdin);
+    }
+
+    std::FILE* fd;
+    if ((fd = std::fopen(path, "rb")) == nullptr) {
+        return nullptr;
+    }
+
+    return sniff(fd);
+}
+
+/*! Picks the reader
+ */
+steg::raster_reader* steg::raster_reader::sniff(std::FILE* fd)
+{
+    // Sniff the format; TGA files have no signature
+    unsigned char sig[4] = {  };
+    const std::size_t n = std::fread(sig, 1, sizeof(sig), fd);
+    std::rewind(fd);
+
+    if (n == sizeof(sig) && ::memcmp(sig, "\x89PNG", 4) == 0) {
+        return png_reader(fd);
+    }
+
+    else if (n == sizeof(sig) && ::memcmp(sig, "qoif", 4) == 0) {
+        return qoi_reader(fd);
+    }
+
+    else if (n >= 2 && sig[0] == 'P' && sig[1] >= '5' && sig[1] <= '7') {
+        return pnm_reader(fd);
+    }
+
+    else if (n >= 2 && sig[0] == 'B' && sig[1] == 'M') {
+        return bmp_reader(fd);
+    }
+
+    else {
+        return tga_reader(fd);
+    }
+}
+
+/*! Skips rows
+ */
+bool steg::raster_reader::skip(const int nrows)
+{
+    // Decode and drop, one row at a time
+    std::unique_ptr<unsigned char[]> row(new unsigned char[static_cast<std::size_t>(w_) * nchanns_ * depth_]);
+
+    for (int i = 0; i != nrows; ++i) {
+        if (!read(row.get(), 1)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*! Moves to a row
+ */
+bool steg::raster_reader::seek(const int)
+{
+    return false;
+}
+
+/*! Locates the pixels
+ */
+bool steg::raster_reader::map(raster_map&) const
+{
+    return false;
+}
+
+/*! dtor.
+ */
+steg::raster_writer::~raster_writer()
+{
+    if (fd_ != nullptr) {
+        std::fclose(fd_);
+    }
+}
+
+/*! ctor.
+ */
+steg::raster_writer::raster_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp) : fd_(fd)
+                                                                                                                   , w_(w)
+                                                                                                                   , h_(h)
+                                                                                                                   , nchanns_(nchanns)
+                                                                                                                   , depth_(1)
+                                                                                                                   , bottomUp_(bottomUp)
+                                                                                                                   , pool_(nullptr) {  }
+
+/*! Factory method
+ */
+steg::raster_writer* steg::raster_writer::create(const char* path, const image::image_type type, const int w, const int h, const int nchanns, const int depth,
+                                                 const bool bottomUp, const compression& comp)
+{
+    // Just in case
+    if (!path) {
+        return ((error::get())->log("Error: invalid save path"), nullptr);
+    }
+
+    if (type != image::PNG && type != image::BMP && type != image::TGA && type != image::QOI && type != image::PNM && type != image::PAM) {
+        return ((error::get())->log("Error: unable to save image ", path), nullptr);
+    }
+
+    if (depth != 1 && type != image::PNG && type != image::PNM && type != image::PAM) {
+        return ((error::get())->log("Error: only PNG, PNM and PAM images can hold 16-bit samples"), nullptr);
+    }
+
+    if (type != image::BMP && type != image::TGA && bottomUp) {
+        return ((error::get())->log("Error: PNG, QOI, PNM and PAM images are saved top row first"), nullptr);
+    }
+
+    const bool piped = (::strcmp(path, "-") == 0);
+    if (piped && type != image::PNM && type != image::PAM) {
+        return ((error::get())->log("Error: only PNM and PAM images can be written to stdout"), nullptr);
+    }
+
+    std::FILE* fd;
+    if ((fd = (piped ? stdout : std::fopen(path, "wb"))) == nullptr) {
+        return ((error::get())->log("Error: unable to save image ", path), nullptr);
+    }
+
+    raster_writer* writer = (type == image::PNG) ? png_writer(fd, w, h, nchanns, depth, comp) :
+                            (type == image::QOI) ? qoi_writer(fd, w, h, nchanns) :
+                            (type == image::PNM || type == image::PAM) ? pnm_writer(fd, w, h, nchanns, depth, type) :
+                            (type == image::BMP) ? bmp_writer(fd, w, h, nchanns, bottomUp) :
+                                                   tga_writer(fd, w, h, nchanns, bottomUp);
+
+    if (writer == nullptr) {
+        (error::get())->log("Error: unable to save image ", path);
+    }
+
+    return writer;
+}
+
+/*! Flushes and closes the file
+ */
+bool steg::raster_writer::close()
+{
+    const bool ret = finish();
+    const bool closed = (std::fclose(fd_) == 0);
+    fd_ = nullptr;
+    return ret && closed;
+}
+
+/*! Writes whatever follows the last row
+ */
+bool steg::raster_writer::finish()
+{
+    return true;
+}
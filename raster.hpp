@@ -0,0 +1,192 @@
+/* raster.hpp -- v1.0 -- reads and writes images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#ifndef _RASTER_HPP
+#define _RASTER_HPP
+
+#include <cstdio>
+
+#include "compression.hpp"
+#include "image.hpp"
+
+namespace steg {
+    class thread_pool;
+
+    // Pixels are interleaved, with the channels stbi_load returns for the same file:
+    // grey, grey + alpha, RGB, or RGBA; QOI images, which stb cannot load, are RGB or RGBA.
+    // Samples are 8-bit, or 16-bit in host byte order for PNG, PNM and PAM files that
+    // store them so, like stbi_load_16 returns them. Rows go left to right, in the order
+    // the file stores them
+
+    /// @class raster_map
+    /// Where the pixels of an image whose file stores them as-is sit
+    struct raster_map {
+
+        image::image_type type; // > file type
+        long offset;            // > first stored row
+        std::size_t rowSize;    // > bytes per stored row, padding included
+        int pixelSize;          // > bytes per stored pixel
+        int order[4];           // > byte of each channel within a stored pixel
+    };
+
+    /// @class raster_reader
+    class raster_reader {
+    public:
+
+        /// dtor.
+        virtual ~raster_reader();
+
+        /// Factory method, picks the reader from the file's contents
+        /// @param path    path/to/image/file, or "-" for a PNM or PAM image on stdin
+        /// @return        on success, a non-null pointer to a reader positioned at the first row
+        static raster_reader* open(const char* path);
+
+        /// Same as open(), but failures are not logged; for callers that have other ways to read the image
+        /// @param path    path/to/image/file
+        /// @return        on success, a non-null pointer to a reader positioned at the first row
+        static raster_reader* probe(const char* path);
+
+        /// @return    image width, height, no. of channels
+        inline int width() const { return w_; }
+        inline int height() const { return h_; }
+        inline int channels() const { return nchanns_; }
+
+        /// @return    bytes per sample, 1 or 2
+        inline int depth() const { return depth_; }
+
+        /// @return    true if the file stores the bottom row first
+        inline bool bottom_up() const { return bottomUp_; }
+
+        /// Reads the next rows
+        /// @param rows     output buffer, nrows * width * channels * depth bytes [out]
+        /// @param nrows    no. of rows
+        /// @return         true on success, false otherwise
+        virtual bool read(unsigned char* rows, const int nrows) = 0;
+
+        /// Skips the next rows
+        /// @param nrows    no. of rows
+        /// @return         true on success, false otherwise
+        virtual bool skip(const int nrows);
+
+        /// Moves to a row, in file order
+        /// @param row    row index
+        /// @return       true on success, false if the file cannot be read out of order
+        virtual bool seek(const int row);
+
+        /// Locates the pixels in the file, for images that can be patched in place
+        /// @param map    where the pixels sit [out]
+        /// @return       true on success, false if pixels are compressed, or changed on load
+        virtual bool map(raster_map& map) const;
+
+    protected:
+
+        /// ctor.
+        explicit raster_reader(std::FILE* fd);
+
+        /// Picks the reader from the file's contents, and parses the header
+        /// @param fd    image file, taken over; closed on failure
+        /// @return      on success, a non-null pointer to a reader positioned at the first row
+        static raster_reader* sniff(std::FILE* fd);
+
+        // Image file
+        std::FILE* fd_;
+
+        // Image width, height, no. of channels
+        int w_, h_, nchanns_;
+
+        // Bytes per sample
+        int depth_;
+
+        // Row order
+        bool bottomUp_;
+
+    private:
+
+        // Non-copyable
+        explicit raster_reader(raster_reader&) = delete;
+        explicit raster_reader(const raster_reader&) = delete;
+    };
+
+    /// @class raster_writer
+    class raster_writer {
+    public:
+
+        /// dtor.
+        virtual ~raster_writer();
+
+        /// Factory method
+        /// @param path        output image path, or "-" for a PNM or PAM image on stdout
+        /// @param type        output image file type
+        /// @param w           image width
+        /// @param h           image height
+        /// @param nchanns     no. of channels of the rows passed to write()
+        /// @param depth       bytes per sample of the rows passed to write(); only PNG, PNM and PAM images take 2
+        /// @param bottomUp    rows are passed bottom row first
+        /// @param comp        how PNG image data is compressed, zlib or stored
+        /// @return            on success, a non-null pointer to a writer that has written the file header
+        static raster_writer* create(const char* path, const image::image_type type, const int w, const int h, const int nchanns, const int depth,
+                                     const bool bottomUp, const compression& comp);
+
+        /// Writes the next rows
+        /// @param rows     input buffer, nrows * width * channels * depth bytes [in]
+        /// @param nrows    no. of rows
+        /// @return         true on success, false otherwise
+        virtual bool write(const unsigned char* rows, const int nrows) = 0;
+
+        /// Lends worker threads to the writer; only PNG compression uses them
+        /// @param pool    worker threads, not owned; nullptr to write on the caller's thread
+        inline void set_pool(thread_pool* pool) {
+            pool_ = pool;
+        }
+
+        /// Flushes and closes the file
+        /// @return    true on success, false otherwise
+        bool close();
+
+    protected:
+
+        /// ctor.
+        raster_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp);
+
+        /// Writes whatever follows the last row
+        /// @return    true on success, false otherwise
+        virtual bool finish();
+
+        // Image file
+        std::FILE* fd_;
+
+        // Image width, height, no. of channels
+        int w_, h_, nchanns_;
+
+        // Bytes per sample
+        int depth_;
+
+        // Row order
+        bool bottomUp_;
+
+        // Worker threads, not owned; nullptr if single-threaded
+        thread_pool* pool_;
+
+    private:
+
+        // Non-copyable
+        explicit raster_writer(raster_writer&) = delete;
+        explicit raster_writer(const raster_writer&) = delete;
+    };
+
+    /// Format-specific factories; each takes over fd, and closes it on failure
+    raster_reader* bmp_reader(std::FILE* fd);
+    raster_reader* tga_reader(std::FILE* fd);
+    raster_reader* png_reader(std::FILE* fd);
+    raster_reader* qoi_reader(std::FILE* fd);
+    raster_reader* pnm_reader(std::FILE* fd);
+    raster_writer* bmp_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp);
+    raster_writer* tga_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp);
+
+    /// PNG, QOI, PNM and PAM rows always go top row first; PNG, PNM and PAM samples may be 16-bit
+    raster_writer* png_writer(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const compression& comp);
+    raster_writer* qoi_writer(std::FILE* fd, const int w, const int h, const int nchanns);
+    raster_writer* pnm_writer(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const image::image_type type);
+}
+
+#endif
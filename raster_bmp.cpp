@@ -0,0 +1,356 @@
+/* raster_bmp.cpp -- v1.0 -- reads and writes uncompressed BMP images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "raster.hpp"
+
+namespace {
+    /*! Helper
+     * Little-endian integers
+     */
+    inline std::uint32_t load32(const unsigned char* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    inline std::uint32_t load16(const unsigned char* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    inline void store32(unsigned char* p, const std::uint32_t value) {
+        p[0] = value & 0xff;
+        p[1] = (value >> 8) & 0xff;
+        p[2] = (value >> 16) & 0xff;
+        p[3] = (value >> 24) & 0xff;
+    }
+
+    inline void store16(unsigned char* p, const std::uint32_t value) {
+        p[0] = value & 0xff;
+        p[1] = (value >> 8) & 0xff;
+    }
+
+    // File header, and the BITMAPINFOHEADER that follows it
+    const std::size_t file_header_size = 14;
+    const std::size_t info_header_size = 40;
+
+    /*! @class: reads 8-bit paletted, 24-bit, and 32-bit uncompressed BMP images
+     */
+    class bmp_input : public steg::raster_reader {
+    public:
+
+        inline explicit bmp_input(std::FILE* fd) : raster_reader(fd), bpp_(0), offset_(0) {  }
+
+        /*! Parses the headers, leaves the file at the first row
+         */
+        bool parse();
+
+        bool read(unsigned char* rows, const int nrows) override;
+        bool skip(const int nrows) override;
+        bool seek(const int row) override;
+        bool map(steg::raster_map& map) const override;
+
+    private:
+
+        // Bits per pixel
+        int bpp_;
+
+        // Offset of the first row
+        long offset_;
+
+        // One row, as stored in the file
+        std::vector<unsigned char> row_;
+
+        // RGB colours, for paletted images
+        unsigned char palette_[256][3];
+    };
+
+    /*! Parses the headers
+     */
+    bool bmp_input::parse()
+    {
+        unsigned char hdr[file_header_size + 124] = {  };
+        if (std::fread(hdr, 1, file_header_size + 4, fd_) != (file_header_size + 4)) {
+            return false;
+        }
+
+        offset_ = load32(hdr + 10);
+        const std::uint32_t hsz = load32(hdr + 14);
+
+        // BITMAPINFOHEADER or later
+        if (hsz < info_header_size || hsz > 124) {
+            return false;
+        }
+
+        if (std::fread(hdr + file_header_size + 4, 1, hsz - 4, fd_) != (hsz - 4)) {
+            return false;
+        }
+
+        const std::int32_t w = static_cast<std::int32_t>(load32(hdr + 18));
+        const std::int32_t h = static_cast<std::int32_t>(load32(hdr + 22));
+        const std::uint32_t compression = load32(hdr + 30);
+
+        bpp_ = load16(hdr + 28);
+        if (load16(hdr + 26) != 1 || w <= 0 || h == 0) {
+            return false;
+        }
+
+        w_ = w;
+        h_ = (h < 0) ? -h : h;
+        bottomUp_ = (h > 0);
+
+        // Pixel layouts stbi_load returns as-is
+        if (bpp_ == 24 && compression == 0) {
+            nchanns_ = 3;
+        }
+
+        else if (bpp_ == 32 && compression == 0) {
+            nchanns_ = 4;
+        }
+
+        else if (bpp_ == 32 && compression == 3)
+        {
+            // Channel masks follow a BITMAPINFOHEADER, or sit in the later headers
+            unsigned char masks[16] = {  };
+            if (hsz == info_header_size) {
+                if (std::fread(masks, 1, 12, fd_) != 12) {
+                    return false;
+                }
+            }
+
+            else {
+                ::memcpy(masks, hdr + file_header_size + info_header_size, (hsz >= 56) ? 16 : 12);
+            }
+
+            if (load32(masks) != 0x00ff0000 || load32(masks + 4) != 0x0000ff00 || load32(masks + 8) != 0x000000ff) {
+                return false;
+            }
+
+            const std::uint32_t alpha = load32(masks + 12);
+            if (alpha != 0 && alpha != 0xff000000) {
+                return false;
+            }
+
+            nchanns_ = (alpha != 0) ? 4 : 3;
+        }
+
+        else if (bpp_ == 8 && compression == 0)
+        {
+            // Expanded to RGB
+            nchanns_ = 3;
+
+            const std::uint32_t ncolors = load32(hdr + 46);
+            const std::size_t n = (ncolors == 0 || ncolors > 256) ? 256 : ncolors;
+
+            unsigned char colors[256 * 4];
+            if (std::fseek(fd_, static_cast<long>(file_header_size + hsz), SEEK_SET) != 0 ||
+                std::fread(colors, 4, n, fd_) != n) {
+                return false;
+            }
+
+            ::memset(palette_, 0, sizeof(palette_));
+            for (std::size_t i = 0; i != n; ++i)
+            {
+                palette_[i][0] = colors[(4 * i) + 2];
+                palette_[i][1] = colors[(4 * i) + 1];
+                palette_[i][2] = colors[(4 * i) + 0];
+            }
+        }
+
+        else {
+            return false; // Not supported
+        }
+
+        // Rows are padded to 4 bytes
+        row_.resize(((static_cast<std::size_t>(w_) * bpp_ + 31) / 32) * 4);
+
+        return std::fseek(fd_, offset_, SEEK_SET) == 0;
+    }
+
+    /*! Reads rows
+     */
+    bool bmp_input::read(unsigned char* rows, const int nrows)
+    {
+        for (int r = 0; r != nrows; ++r)
+        {
+            if (std::fread(row_.data(), 1, row_.size(), fd_) != row_.size()) {
+                return false;
+            }
+
+            const unsigned char* in = row_.data();
+            switch (bpp_)
+            {
+                // BGR to RGB
+                case 24:
+                {
+                    for (int x = 0; x != w_; ++x, in += 3, rows += 3)
+                    {
+                        rows[0] = in[2];
+                        rows[1] = in[1];
+                        rows[2] = in[0];
+                    }
+                    break;
+                }
+
+                // BGRA to RGB(A)
+                case 32:
+                {
+                    for (int x = 0; x != w_; ++x, in += 4, rows += nchanns_)
+                    {
+                        rows[0] = in[2];
+                        rows[1] = in[1];
+                        rows[2] = in[0];
+                        if (nchanns_ == 4) {
+                            rows[3] = in[3];
+                        }
+                    }
+                    break;
+                }
+
+                // Palette to RGB
+                default:
+                {
+                    for (int x = 0; x != w_; ++x, ++in, rows += 3) {
+                        ::memcpy(rows, palette_[*in], 3);
+                    }
+                    break;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /*! Skips rows
+     */
+    bool bmp_input::skip(const int nrows)
+    {
+        return std::fseek(fd_, static_cast<long>(row_.size() * nrows), SEEK_CUR) == 0;
+    }
+
+    /*! Moves to a row
+     */
+    bool bmp_input::seek(const int row)
+    {
+        return std::fseek(fd_, offset_ + static_cast<long>(row_.size() * row), SEEK_SET) == 0;
+    }
+
+    /*! Locates the pixels
+     */
+    bool bmp_input::map(steg::raster_map& map) const
+    {
+        // Alpha is ignored on load if it is all zeros, which patching could change
+        if ((bpp_ != 24 && bpp_ != 32) || nchanns_ != 3) {
+            return false;
+        }
+
+        map = { steg::image::BMP, offset_, row_.size(), bpp_ / 8, { 2, 1, 0, 0 } };
+        return true;
+    }
+
+    /*! @class: writes uncompressed BMP images, 24-bit like stbi_write_bmp, or 32-bit to keep alpha
+     */
+    class bmp_output : public steg::raster_writer {
+    public:
+
+        inline bmp_output(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp)
+            : raster_writer(fd, w, h, nchanns, bottomUp)
+            , bpp_((nchanns == 4) ? 32 : 24)
+            , row_(((static_cast<std::size_t>(w) * bpp_ + 31) / 32) * 4, 0) {  }
+
+        /*! Writes the headers
+         */
+        bool begin();
+
+        bool write(const unsigned char* rows, const int nrows) override;
+
+    private:
+
+        // Bits per pixel
+        int bpp_;
+
+        // One row, as stored in the file
+        std::vector<unsigned char> row_;
+    };
+
+    /*! Writes the headers
+     */
+    bool bmp_output::begin()
+    {
+        unsigned char hdr[file_header_size + info_header_size] = {  };
+
+        hdr[0] = 'B';
+        hdr[1] = 'M';
+        store32(hdr + 2, static_cast<std::uint32_t>(sizeof(hdr) + (row_.size() * h_)));
+        store32(hdr + 10, sizeof(hdr));
+
+        store32(hdr + 14, info_header_size);
+        store32(hdr + 18, w_);
+        store32(hdr + 22, static_cast<std::uint32_t>(bottomUp_ ? h_ : -h_)); // > negative if top-down
+        store16(hdr + 26, 1);
+        store16(hdr + 28, bpp_);
+
+        return std::fwrite(hdr, 1, sizeof(hdr), fd_) == sizeof(hdr);
+    }
+
+    /*! Writes rows
+     */
+    bool bmp_output::write(const unsigned char* rows, const int nrows)
+    {
+        for (int r = 0; r != nrows; ++r)
+        {
+            unsigned char* out = row_.data();
+            for (int x = 0; x != w_; ++x, rows += nchanns_)
+            {
+                // Grey is expanded, and its alpha dropped, like stbi_write_bmp does
+                if (nchanns_ < 3)
+                {
+                    out[0] = out[1] = out[2] = rows[0];
+                    out += 3;
+                    continue;
+                }
+
+                out[0] = rows[2];
+                out[1] = rows[1];
+                out[2] = rows[0];
+                if (nchanns_ == 4) {
+                    out[3] = rows[3];
+                }
+
+                out += (bpp_ / 8);
+            }
+
+            if (std::fwrite(row_.data(), 1, row_.size(), fd_) != row_.size()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/*! BMP reader
+ */
+steg::raster_reader* steg::bmp_reader(std::FILE* fd)
+{
+    bmp_input* reader = new bmp_input(fd);
+    if (!reader->parse()) {
+        return (delete reader, nullptr);
+    }
+
+    return reader;
+}
+
+/*! BMP writer
+ */
+steg::raster_writer* steg::bmp_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp)
+{
+    bmp_output* writer = new bmp_output(fd, w, h, nchanns, bottomUp);
+    if (!writer->begin()) {
+        return (delete writer, nullptr);
+    }
+
+    return writer;
+}
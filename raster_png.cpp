@@ -0,0 +1,904 @@
+/* raster_png.cpp -- v1.0 -- reads and writes PNG images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <zlib.h>
+
+#include "raster.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+    /*! Helper
+     * Big-endian integers
+     */
+    inline std::uint32_t load32(const unsigned char* p) {
+        return (static_cast<std::uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    inline void store32(unsigned char* p, const std::uint32_t value) {
+        p[0] = (value >> 24) & 0xff;
+        p[1] = (value >> 16) & 0xff;
+        p[2] = (value >> 8) & 0xff;
+        p[3] = value & 0xff;
+    }
+
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    // Colour types
+    const int grey = 0;
+    const int rgb = 2;
+    const int indexed = 3;
+    const int grey_alpha = 4;
+    const int rgb_alpha = 6;
+
+    // Row filters
+    enum filter { none, sub, up, average, paeth, nfilters };
+
+    // Compressed data per IDAT chunk
+    const std::size_t chunk_size = 64 * 1024;
+
+    // Filtered data per band, deflated as a piece
+    const std::size_t band_size = 256 * 1024;
+    // Deflate window; each band is primed with this much of the band before
+    const std::size_t window_size = 32 * 1024;
+
+    /*! Helper
+     * Predictor of the Paeth filter
+     */
+    inline int predict(const int a, const int b, const int c)
+    {
+        const int p = a + b - c;
+        const int pa = std::abs(p - a);
+        const int pb = std::abs(p - b);
+        const int pc = std::abs(p - c);
+
+        if (pa <= pb && pa <= pc) {
+            return a;
+        }
+
+        return (pb <= pc) ? b : c;
+    }
+
+    /*! @class: reads non-interlaced PNG images, any bit depth and colour type
+     * Samples are converted the way stbi_load converts them: low bit depth greys
+     * are scaled to 8 bits, palettes are expanded, and a tRNS chunk adds an alpha
+     * channel; 16-bit samples are kept whole, the way stbi_load_16 returns them
+     */
+    class png_input : public steg::raster_reader {
+    public:
+
+        inline explicit png_input(std::FILE* fd) : raster_reader(fd)
+                                                  , bitDepth_(0)
+                                                  , type_(0)
+                                                  , nsamples_(0)
+                                                  , transparent_(false)
+                                                  , remaining_(0)
+                                                  , inflating_(false)
+                                                  , in_(chunk_size) {  }
+
+        ~png_input() override {
+            if (inflating_) {
+                inflateEnd(&strm_);
+            }
+        }
+
+        /*! Parses the chunks up to the first IDAT, leaves the file at the first row
+         */
+        bool parse();
+
+        bool read(unsigned char* rows, const int nrows) override;
+
+    private:
+
+        /*! Inflates the next n bytes of image data
+         */
+        bool inflate_bytes(unsigned char* out, const std::size_t n);
+
+        /*! Converts a row to stb's layout
+         */
+        void convert(const unsigned char* in, unsigned char* out) const;
+
+        // Bit depth, colour type, samples per pixel in the file
+        int bitDepth_, type_, nsamples_;
+
+        // Palette, RGBA
+        unsigned char palette_[256][4];
+
+        // Transparent colour, if a tRNS chunk is present (grey and RGB images)
+        bool transparent_;
+        unsigned int key_[3];
+
+        // Bytes left in the current IDAT chunk
+        std::uint32_t remaining_;
+
+        // Decompressor
+        z_stream strm_;
+        bool inflating_;
+
+        // Compressed data
+        std::vector<unsigned char> in_;
+
+        // Current and previous row, filter byte first
+        std::vector<unsigned char> row_, prior_;
+    };
+
+    /*! Parses the chunks
+     */
+    bool png_input::parse()
+    {
+        unsigned char sig[8];
+        if (std::fread(sig, 1, sizeof(sig), fd_) != sizeof(sig) || ::memcmp(sig, signature, sizeof(sig)) != 0) {
+            return false;
+        }
+
+        for (int i = 0; i != 256; ++i) {
+            palette_[i][0] = palette_[i][1] = palette_[i][2] = 0;
+            palette_[i][3] = 0xff;
+        }
+
+        bool header = false;
+        while (true)
+        {
+            unsigned char chunk[8];
+            if (std::fread(chunk, 1, sizeof(chunk), fd_) != sizeof(chunk)) {
+                return false;
+            }
+
+            const std::uint32_t length = load32(chunk);
+            if (length > 0x7fffffff) {
+                return false;
+            }
+
+            // Image data, the rows start here
+            if (::memcmp(chunk + 4, "IDAT", 4) == 0)
+            {
+                if (!header) {
+                    return false;
+                }
+
+                remaining_ = length;
+                break;
+            }
+
+            std::vector<unsigned char> data(length);
+            if (std::fread(data.data(), 1, length, fd_) != length || std::fseek(fd_, 4, SEEK_CUR) != 0) {
+                return false; // > data and CRC
+            }
+
+            if (::memcmp(chunk + 4, "IHDR", 4) == 0)
+            {
+                if (length != 13) {
+                    return false;
+                }
+
+                const std::uint32_t w = load32(data.data());
+                const std::uint32_t h = load32(data.data() + 4);
+                bitDepth_ = data[8];
+                type_ = data[9];
+
+                // Interlaced rows cannot be streamed
+                if (w == 0 || h == 0 || w > 0x7fffffff || h > 0x7fffffff || data[10] != 0 || data[11] != 0 || data[12] != 0) {
+                    return false;
+                }
+
+                w_ = static_cast<int>(w);
+                h_ = static_cast<int>(h);
+
+                switch (type_)
+                {
+                    case grey:       nsamples_ = 1; break;
+                    case rgb:        nsamples_ = 3; break;
+                    case indexed:    nsamples_ = 1; break;
+                    case grey_alpha: nsamples_ = 2; break;
+                    case rgb_alpha:  nsamples_ = 4; break;
+
+                    default: {
+                        return false;
+                    }
+                }
+
+                // Valid bit depths for the colour type
+                const bool low = (type_ == grey || type_ == indexed) && (bitDepth_ == 1 || bitDepth_ == 2 || bitDepth_ == 4);
+                if (!(low || bitDepth_ == 8 || (bitDepth_ == 16 && type_ != indexed))) {
+                    return false;
+                }
+
+                header = true;
+            }
+
+            else if (::memcmp(chunk + 4, "PLTE", 4) == 0)
+            {
+                if (length > 768 || (length % 3) != 0) {
+                    return false;
+                }
+
+                for (std::uint32_t i = 0; i != length / 3; ++i) {
+                    ::memcpy(palette_[i], data.data() + (3 * i), 3);
+                }
+            }
+
+            else if (::memcmp(chunk + 4, "tRNS", 4) == 0)
+            {
+                if (!header) {
+                    return false;
+                }
+
+                if (type_ == indexed)
+                {
+                    if (length > 256) {
+                        return false;
+                    }
+
+                    for (std::uint32_t i = 0; i != length; ++i) {
+                        palette_[i][3] = data[i];
+                    }
+
+                    transparent_ = true;
+                }
+
+                else if ((type_ == grey || type_ == rgb) && length == (2u * nsamples_))
+                {
+                    for (int i = 0; i != nsamples_; ++i) {
+                        key_[i] = (data[2 * i] << 8) | data[(2 * i) + 1];
+                    }
+
+                    transparent_ = true;
+                }
+
+                else {
+                    return false;
+                }
+            }
+
+            else if (::memcmp(chunk + 4, "IEND", 4) == 0) {
+                return false; // No image data
+            }
+        }
+
+        // Palettes are expanded, and a transparent colour takes an alpha channel
+        nchanns_ = (type_ == indexed) ? (transparent_ ? 4 : 3) : (nsamples_ + (transparent_ ? 1 : 0));
+        depth_ = (bitDepth_ == 16) ? 2 : 1;
+        bottomUp_ = false;
+
+        const std::size_t rowSize = ((static_cast<std::size_t>(w_) * nsamples_ * bitDepth_) + 7) / 8;
+        row_.assign(rowSize + 1, 0);
+        prior_.assign(rowSize + 1, 0);
+
+        ::memset(&strm_, 0, sizeof(strm_));
+        return (inflating_ = (inflateInit(&strm_) == Z_OK));
+    }
+
+    /*! Inflates image data
+     */
+    bool png_input::inflate_bytes(unsigned char* out, const std::size_t n)
+    {
+        strm_.next_out = out;
+        strm_.avail_out = static_cast<uInt>(n);
+
+        while (strm_.avail_out != 0)
+        {
+            // Next chunk of compressed data; IDAT chunks follow one another
+            if (strm_.avail_in == 0)
+            {
+                while (remaining_ == 0)
+                {
+                    unsigned char chunk[12];
+                    if (std::fread(chunk, 1, sizeof(chunk), fd_) != sizeof(chunk) || ::memcmp(chunk + 8, "IDAT", 4) != 0) {
+                        return false; // > CRC of the previous chunk, then the next chunk
+                    }
+
+                    remaining_ = load32(chunk + 4);
+                }
+
+                const std::size_t size = (remaining_ < in_.size()) ? remaining_ : in_.size();
+                if (std::fread(in_.data(), 1, size, fd_) != size) {
+                    return false;
+                }
+
+                remaining_ -= static_cast<std::uint32_t>(size);
+                strm_.next_in = in_.data();
+                strm_.avail_in = static_cast<uInt>(size);
+            }
+
+            const int ret = inflate(&strm_, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                return strm_.avail_out == 0;
+            }
+
+            if (ret != Z_OK) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*! Reads rows
+     */
+    bool png_input::read(unsigned char* rows, const int nrows)
+    {
+        const std::size_t size = row_.size() - 1;
+        const std::size_t bpp = ((nsamples_ * bitDepth_) + 7) / 8; // > distance to the byte a filter looks back to
+
+        for (int r = 0; r != nrows; ++r, rows += (static_cast<std::size_t>(w_) * nchanns_ * depth_))
+        {
+            if (!inflate_bytes(row_.data(), row_.size())) {
+                return false;
+            }
+
+            unsigned char* const cur = row_.data() + 1;
+            const unsigned char* const prev = prior_.data() + 1;
+
+            // Undo the filter
+            switch (row_[0])
+            {
+                case none: {
+                    break;
+                }
+
+                case sub:
+                {
+                    for (std::size_t i = bpp; i < size; ++i) {
+                        cur[i] += cur[i - bpp];
+                    }
+                    break;
+                }
+
+                case up:
+                {
+                    for (std::size_t i = 0; i != size; ++i) {
+                        cur[i] += prev[i];
+                    }
+                    break;
+                }
+
+                case average:
+                {
+                    for (std::size_t i = 0; i != size; ++i) {
+                        cur[i] += ((i < bpp ? 0 : cur[i - bpp]) + prev[i]) / 2;
+                    }
+                    break;
+                }
+
+                case paeth:
+                {
+                    for (std::size_t i = 0; i != size; ++i) {
+                        cur[i] += predict(i < bpp ? 0 : cur[i - bpp], prev[i], i < bpp ? 0 : prev[i - bpp]);
+                    }
+                    break;
+                }
+
+                default: {
+                    return false;
+                }
+            }
+
+            convert(cur, rows);
+            row_.swap(prior_);
+        }
+
+        return true;
+    }
+
+    /*! Converts a row
+     */
+    void png_input::convert(const unsigned char* in, unsigned char* out) const
+    {
+        // Most images
+        if (bitDepth_ == 8 && type_ != indexed && !transparent_) {
+            ::memcpy(out, in, static_cast<std::size_t>(w_) * nchanns_);
+            return;
+        }
+
+        // 16-bit samples, big-endian in the file
+        if (bitDepth_ == 16)
+        {
+            std::uint16_t* wide = reinterpret_cast<std::uint16_t*>(out);
+
+            for (int x = 0; x != w_; ++x, in += (2 * nsamples_), wide += nchanns_)
+            {
+                bool match = transparent_;
+                for (int i = 0; i != nsamples_; ++i)
+                {
+                    wide[i] = static_cast<std::uint16_t>((in[2 * i] << 8) | in[(2 * i) + 1]);
+                    match = match && (wide[i] == key_[i]);
+                }
+
+                if (transparent_) {
+                    wide[nsamples_] = match ? 0x0000 : 0xffff;
+                }
+            }
+
+            return;
+        }
+
+        // Low bit depth greys are scaled to 0-255
+        static const unsigned char scale[9] = { 0, 0xff, 0x55, 0, 0x11, 0, 0, 0, 0x01 };
+
+        for (int x = 0; x != w_; ++x, out += nchanns_)
+        {
+            unsigned int samples[4];
+
+            for (int i = 0; i != nsamples_; ++i)
+            {
+                const std::size_t k = (static_cast<std::size_t>(x) * nsamples_) + i;
+
+                switch (bitDepth_)
+                {
+                    case 8:  samples[i] = in[k]; break;
+
+                    default: {
+                        const std::size_t bit = k * bitDepth_;
+                        samples[i] = (in[bit / 8] >> (8 - bitDepth_ - (bit % 8))) & ((1u << bitDepth_) - 1);
+                        break;
+                    }
+                }
+            }
+
+            if (type_ == indexed)
+            {
+                ::memcpy(out, palette_[samples[0]], nchanns_);
+                continue;
+            }
+
+            bool match = transparent_;
+            for (int i = 0; i != nsamples_; ++i)
+            {
+                // The transparent colour is compared before samples are narrowed
+                match = match && (samples[i] == (key_[i] & 0xff));
+                out[i] = (bitDepth_ < 8) ? (samples[i] * scale[bitDepth_]) : samples[i];
+            }
+
+            if (transparent_) {
+                out[nsamples_] = match ? 0x00 : 0xff;
+            }
+        }
+    }
+
+    /*! Helper
+     * Runs a row through filter F, returns how far its bytes are from zero
+     * a, b, c are the bytes left of, above, and above left of each byte
+     */
+    template <int F>
+    unsigned long filter_with(const unsigned char* row, const unsigned char* prev, const std::size_t size, const std::size_t bpp, unsigned char* out)
+    {
+        unsigned long sum = 0;
+        for (std::size_t i = 0; i != size; ++i)
+        {
+            const int a = (i < bpp) ? 0 : row[i - bpp];
+            const int b = prev[i];
+            const int c = (i < bpp) ? 0 : prev[i - bpp];
+
+            const int pred = (F == sub) ? a : (F == up) ? b : (F == average) ? ((a + b) / 2) : (F == paeth) ? predict(a, b, c) : 0;
+
+            out[i] = static_cast<unsigned char>(row[i] - pred);
+            sum += std::abs(static_cast<signed char>(out[i]));
+        }
+
+        return sum;
+    }
+
+    /*! Helper
+     * Filters a row the way whose bytes come out closest to zero, filter byte first;
+     * only the first (nf) filters are tried, each into its own row of (trial)
+     */
+    void filter_row(const unsigned char* row, const unsigned char* prev, const std::size_t size, const std::size_t bpp, const int nf,
+                    unsigned char* trial, unsigned char* out)
+    {
+        static unsigned long (* const filters[nfilters])(const unsigned char*, const unsigned char*, const std::size_t, const std::size_t, unsigned char*) = {
+            &filter_with<none>, &filter_with<sub>, &filter_with<up>, &filter_with<average>, &filter_with<paeth>
+        };
+
+        int best = none;
+        unsigned long least = static_cast<unsigned long>(-1);
+
+        for (int f = 0; f != nf; ++f)
+        {
+            const unsigned long sum = filters[f](row, prev, size, bpp, trial + (f * size));
+            if (sum < least)
+            {
+                least = sum;
+                best = f;
+            }
+        }
+
+        out[0] = static_cast<unsigned char>(best);
+        ::memcpy(out + 1, trial + (best * size), size);
+    }
+
+    /*! @class: writes 8 or 16-bit PNG images, each row with the filter that suits it best
+     * Rows are filtered and deflated a band at a time, several bands in parallel. Each
+     * band is a raw deflate stream of its own, primed with the tail of the band before
+     * and ended with a full flush, so the bands join into a single zlib stream; band
+     * boundaries only depend on the image, the output is the same for any no. of threads.
+     * Stored images are left unfiltered, they would not get any smaller
+     */
+    class png_output : public steg::raster_writer {
+    public:
+
+        inline png_output(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const steg::compression& comp)
+            : raster_writer(fd, w, h, nchanns, false)
+            , comp_(comp)
+            , rowSize_(static_cast<std::size_t>(w) * nchanns * depth)
+            , bandRows_(std::max<std::size_t>(band_size / (rowSize_ + 1), 1))
+            , npending_(0)
+            , prior_(rowSize_, 0)
+            , adler_(adler32(0L, Z_NULL, 0))
+            , out_(chunk_size)
+            , nout_(0) {
+            depth_ = depth;
+        }
+
+        ~png_output() override {
+            for (slot& s : slots_) {
+                if (s.init) {
+                    deflateEnd(&s.strm);
+                }
+            }
+        }
+
+        /*! Writes the signature and header
+         */
+        bool begin();
+
+        bool write(const unsigned char* rows, const int nrows) override;
+
+    protected:
+
+        bool finish() override;
+
+    private:
+
+        /*! @class: a band on its way through
+         */
+        struct slot {
+
+            z_stream strm;                       // > raw deflate stream, reset for every band
+            bool init;
+
+            std::vector<unsigned char> trial;    // > a row through each filter
+            std::vector<unsigned char> filtered; // > filtered rows, each filter byte first
+            std::size_t nfiltered;
+            std::vector<unsigned char> packed;   // > deflated rows
+            std::size_t npacked;
+
+            uLong adler;                         // > checksum of the filtered rows
+            bool ok;
+        };
+
+        /*! Sets up a slot per thread, once the pool is known
+         */
+        bool prepare();
+
+        /*! Filters, then deflates the pending rows; the last band ends the stream if (last)
+         */
+        bool flush(const bool last);
+
+        /*! Deflates a band
+         */
+        bool deflate_band(slot& s, const unsigned char* dict, const std::size_t ndict, const bool last);
+
+        /*! Runs task(i) for every i in [0, ntasks), on the pool if there is one
+         */
+        void run(const std::size_t ntasks, const std::function<void(const std::size_t)>& task);
+
+        /*! Appends compressed data, writes an IDAT chunk whenever the output fills up
+         */
+        bool emit(const unsigned char* data, std::size_t size);
+
+        /*! Writes a chunk
+         */
+        bool chunk(const char* type, const unsigned char* data, const std::size_t size);
+
+        // Deflate implementation and level
+        steg::compression comp_;
+
+        // Bytes per row, and rows per band
+        std::size_t rowSize_;
+        std::size_t bandRows_;
+
+        // One slot per band deflated at the same time
+        std::vector<slot> slots_;
+
+        // Rows not yet filtered
+        std::vector<unsigned char> pending_;
+        std::size_t npending_;
+
+        // Row before the pending ones, zeros before the first
+        std::vector<unsigned char> prior_;
+        // Tail of the last band, primes the next one
+        std::vector<unsigned char> window_;
+
+        // Checksum of the filtered rows so far
+        uLong adler_;
+
+        // Compressed data not yet written
+        std::vector<unsigned char> out_;
+        std::size_t nout_;
+    };
+
+    /*! Writes the header
+     */
+    bool png_output::begin()
+    {
+        static const int types[5] = { 0, grey, grey_alpha, rgb, rgb_alpha };
+
+        unsigned char ihdr[13] = {  };
+        store32(ihdr, w_);
+        store32(ihdr + 4, h_);
+        ihdr[8] = static_cast<unsigned char>(8 * depth_);
+        ihdr[9] = types[nchanns_];
+
+        if (std::fwrite(signature, 1, sizeof(signature), fd_) != sizeof(signature) || !chunk("IHDR", ihdr, sizeof(ihdr))) {
+            return false;
+        }
+
+        // zlib header, deflate with a 32 KiB window; the level hint is the one zlib writes
+        const int level = (comp_.method == steg::compression::STORE) ? 0 : comp_.level;
+        const unsigned int hint = (level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+        unsigned int head = (0x78 << 8) | (hint << 6);
+        head += 31 - (head % 31);
+
+        const unsigned char zhead[2] = { static_cast<unsigned char>(head >> 8), static_cast<unsigned char>(head & 0xff) };
+        return emit(zhead, sizeof(zhead));
+    }
+
+    /*! Sets up the slots
+     */
+    bool png_output::prepare()
+    {
+        const int level = (comp_.method == steg::compression::STORE) ? Z_NO_COMPRESSION : comp_.level;
+
+        slots_.resize(pool_ ? pool_->size() : 1);
+        pending_.resize(slots_.size() * bandRows_ * rowSize_);
+
+        for (slot& s : slots_)
+        {
+            ::memset(&s.strm, 0, sizeof(s.strm));
+            if (!(s.init = (deflateInit2(&s.strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK))) {
+                return false;
+            }
+
+            s.trial.resize(nfilters * rowSize_);
+            s.filtered.resize(bandRows_ * (rowSize_ + 1));
+            // Room for the flush marker too
+            s.packed.resize(deflateBound(&s.strm, s.filtered.size()) + 16);
+        }
+
+        return true;
+    }
+
+    /*! Writes rows
+     */
+    bool png_output::write(const unsigned char* rows, const int nrows)
+    {
+        if (slots_.empty() && !prepare()) {
+            return false;
+        }
+
+        const std::size_t capacity = slots_.size() * bandRows_;
+
+        for (std::size_t r = 0; r != static_cast<std::size_t>(nrows); )
+        {
+            // Only deflated once more rows show that the last band is not the image's last
+            if (npending_ == capacity && !flush(false)) {
+                return false;
+            }
+
+            const std::size_t n = std::min(nrows - r, capacity - npending_);
+            unsigned char* const dst = pending_.data() + (npending_ * rowSize_);
+            ::memcpy(dst, rows + (r * rowSize_), n * rowSize_);
+
+            // 16-bit samples go big-endian
+            if (depth_ == 2)
+            {
+                for (std::size_t i = 0; i != (n * rowSize_); i += 2)
+                {
+                    std::uint16_t sample;
+                    ::memcpy(&sample, dst + i, 2);
+                    dst[i] = static_cast<unsigned char>(sample >> 8);
+                    dst[i + 1] = static_cast<unsigned char>(sample & 0xff);
+                }
+            }
+
+            npending_ += n;
+            r += n;
+        }
+
+        return true;
+    }
+
+    /*! Filters and deflates the pending rows
+     */
+    bool png_output::flush(const bool last)
+    {
+        const std::size_t bpp = static_cast<std::size_t>(nchanns_) * depth_;
+        const int nf = (comp_.method == steg::compression::STORE) ? 1 : nfilters;
+
+        // An empty image still needs the final block
+        const std::size_t nbands = std::max<std::size_t>((npending_ + bandRows_ - 1) / bandRows_, last ? 1 : 0);
+
+        run(nbands, [&](const std::size_t j) {
+            slot& s = slots_[j];
+            const std::size_t r0 = j * bandRows_;
+            const std::size_t n = std::min(bandRows_, npending_ - r0);
+
+            for (std::size_t r = r0; r != r0 + n; ++r)
+            {
+                const unsigned char* const prev = (r == 0) ? prior_.data() : pending_.data() + ((r - 1) * rowSize_);
+                filter_row(pending_.data() + (r * rowSize_), prev, rowSize_, bpp, nf, s.trial.data(), s.filtered.data() + ((r - r0) * (rowSize_ + 1)));
+            }
+
+            s.nfiltered = n * (rowSize_ + 1);
+        });
+
+        // Every band but the first is primed with the one before
+        run(nbands, [&](const std::size_t j) {
+            slot& s = slots_[j];
+            if (j == 0)
+            {
+                s.ok = deflate_band(s, window_.data(), window_.size(), last && nbands == 1);
+                return;
+            }
+
+            const slot& p = slots_[j - 1];
+            const std::size_t ndict = std::min(window_size, p.nfiltered);
+            s.ok = deflate_band(s, p.filtered.data() + (p.nfiltered - ndict), ndict, last && (j + 1) == nbands);
+        });
+
+        for (std::size_t j = 0; j != nbands; ++j)
+        {
+            const slot& s = slots_[j];
+            if (!s.ok || !emit(s.packed.data(), s.npacked)) {
+                return false;
+            }
+
+            adler_ = adler32_combine(adler_, s.adler, s.nfiltered);
+        }
+
+        const slot& p = slots_[nbands - 1];
+        const std::size_t ndict = std::min(window_size, p.nfiltered);
+        window_.assign(p.filtered.data() + (p.nfiltered - ndict), p.filtered.data() + p.nfiltered);
+
+        if (npending_ != 0) {
+            ::memcpy(prior_.data(), pending_.data() + ((npending_ - 1) * rowSize_), rowSize_);
+        }
+
+        npending_ = 0;
+        return true;
+    }
+
+    /*! Deflates a band
+     */
+    bool png_output::deflate_band(slot& s, const unsigned char* dict, const std::size_t ndict, const bool last)
+    {
+        if (deflateReset(&s.strm) != Z_OK) {
+            return false;
+        }
+
+        if (ndict != 0 && deflateSetDictionary(&s.strm, dict, static_cast<uInt>(ndict)) != Z_OK) {
+            return false;
+        }
+
+        s.strm.next_in = s.filtered.data();
+        s.strm.avail_in = static_cast<uInt>(s.nfiltered);
+        s.strm.next_out = s.packed.data();
+        s.strm.avail_out = static_cast<uInt>(s.packed.size());
+
+        // A full flush ends on a byte boundary, and leaves the stream open for the next band
+        const int ret = deflate(&s.strm, last ? Z_FINISH : Z_FULL_FLUSH);
+
+        s.npacked = s.packed.size() - s.strm.avail_out;
+        s.adler = adler32(adler32(0L, Z_NULL, 0), s.filtered.data(), static_cast<uInt>(s.nfiltered));
+
+        return last ? (ret == Z_STREAM_END) : (ret == Z_OK && s.strm.avail_in == 0 && s.strm.avail_out != 0);
+    }
+
+    /*! Runs tasks
+     */
+    void png_output::run(const std::size_t ntasks, const std::function<void(const std::size_t)>& task)
+    {
+        if (pool_ == nullptr || ntasks < 2)
+        {
+            for (std::size_t i = 0; i != ntasks; ++i) {
+                task(i);
+            }
+
+            return;
+        }
+
+        pool_->run(ntasks, task);
+    }
+
+    /*! Flushes the image data, writes the trailer
+     */
+    bool png_output::finish()
+    {
+        if ((slots_.empty() && !prepare()) || !flush(true)) {
+            return false;
+        }
+
+        unsigned char tail[4];
+        store32(tail, static_cast<std::uint32_t>(adler_));
+
+        return emit(tail, sizeof(tail)) && (nout_ == 0 || chunk("IDAT", out_.data(), nout_)) && chunk("IEND", nullptr, 0);
+    }
+
+    /*! Appends compressed data
+     */
+    bool png_output::emit(const unsigned char* data, std::size_t size)
+    {
+        while (size != 0)
+        {
+            const std::size_t n = std::min(size, out_.size() - nout_);
+            ::memcpy(out_.data() + nout_, data, n);
+
+            nout_ += n;
+            data += n;
+            size -= n;
+
+            // Output full, emit a chunk
+            if (nout_ == out_.size())
+            {
+                if (!chunk("IDAT", out_.data(), nout_)) {
+                    return false;
+                }
+
+                nout_ = 0;
+            }
+        }
+
+        return true;
+    }
+
+    /*! Writes a chunk
+     */
+    bool png_output::chunk(const char* type, const unsigned char* data, const std::size_t size)
+    {
+        unsigned char head[8], tail[4];
+        store32(head, static_cast<std::uint32_t>(size));
+        ::memcpy(head + 4, type, 4);
+
+        // CRC covers the type and the data
+        uLong crc = crc32(0, head + 4, 4);
+        if (size != 0) {
+            crc = crc32(crc, data, static_cast<uInt>(size));
+        }
+        store32(tail, static_cast<std::uint32_t>(crc));
+
+        return std::fwrite(head, 1, sizeof(head), fd_) == sizeof(head) &&
+               std::fwrite(data, 1, size, fd_) == size &&
+               std::fwrite(tail, 1, sizeof(tail), fd_) == sizeof(tail);
+    }
+}
+
+/*! PNG reader
+ */
+steg::raster_reader* steg::png_reader(std::FILE* fd)
+{
+    png_input* reader = new png_input(fd);
+    if (!reader->parse()) {
+        return (delete reader, nullptr);
+    }
+
+    return reader;
+}
+
+/*! PNG writer
+ */
+steg::raster_writer* steg::png_writer(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const compression& comp)
+{
+    png_output* writer = new png_output(fd, w, h, nchanns, depth, comp);
+    if (!writer->begin()) {
+        return (delete writer, nullptr);
+    }
+
+    return writer;
+}
@@ -0,0 +1,398 @@
+/* raster_pnm.cpp -- v1.0 -- reads and writes binary PGM, PPM and PAM images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "raster.hpp"
+
+namespace {
+    // Rows kept for going back, when the file cannot seek (pipes)
+    const std::size_t cache_size = 4 * 1024 * 1024;
+
+    // Tuple types, by no. of channels
+    const char* const tuple_types[] = { "", "GRAYSCALE", "GRAYSCALE_ALPHA", "RGB", "RGB_ALPHA" };
+
+    /*! Helper
+     * Reads a decimal number from a PGM or PPM header, after whitespace and comments
+     */
+    bool token(std::FILE* fd, long& value)
+    {
+        int ch = std::fgetc(fd);
+        for ( ; ; ch = std::fgetc(fd))
+        {
+            if (ch == '#') {
+                while ((ch = std::fgetc(fd)) != EOF && ch != '\n') {  }
+            }
+
+            if (ch == EOF || !std::isspace(ch)) {
+                break;
+            }
+        }
+
+        if (ch == EOF || !std::isdigit(ch)) {
+            return false;
+        }
+
+        for (value = 0; ch != EOF && std::isdigit(ch); ch = std::fgetc(fd))
+        {
+            value = (value * 10) + (ch - '0');
+            if (value > 0x7fffffff) {
+                return false;
+            }
+        }
+
+        // A single whitespace character ends the number
+        return ch != EOF && std::isspace(ch);
+    }
+
+    /*! Helper
+     * Swaps 16-bit samples between big-endian, as the files store them, and host byte order
+     */
+    void swap16(unsigned char* samples, const std::size_t size)
+    {
+        for (std::size_t i = 0; i != size; i += 2)
+        {
+            const std::uint16_t sample = static_cast<std::uint16_t>((samples[i] << 8) | samples[i + 1]);
+            ::memcpy(samples + i, &sample, 2);
+        }
+    }
+
+    /*! @class: reads binary PGM (P5), PPM (P6) and PAM (P7) images, 8 or 16 bits per sample
+     */
+    class pnm_input : public steg::raster_reader {
+    public:
+
+        inline explicit pnm_input(std::FILE* fd) : raster_reader(fd), type_(steg::image::PNM), maxval_(0), offset_(0), seekable_(false)
+                                                 , next_(0), streamed_(0), ncached_(0) {  }
+
+        /*! Parses the header, leaves the file at the first row
+         */
+        bool parse();
+
+        bool read(unsigned char* rows, const int nrows) override;
+        bool skip(const int nrows) override;
+        bool seek(const int row) override;
+        bool map(steg::raster_map& map) const override;
+
+    private:
+
+        /*! Parses the rest of a PAM header
+         */
+        bool parse_pam();
+
+        // P5 and P6, or P7
+        steg::image::image_type type_;
+
+        // Largest sample value
+        long maxval_;
+
+        // Offset of the first row
+        long offset_;
+
+        // The file can seek; otherwise, the first rows are kept in cache_ so they can be read again
+        bool seekable_;
+
+        // Next row, rows read from the file so far, and rows in the cache
+        int next_;
+        int streamed_;
+        int ncached_;
+        std::vector<unsigned char> cache_;
+    };
+
+    /*! Parses the header
+     */
+    bool pnm_input::parse()
+    {
+        char magic[2];
+        if (std::fread(magic, 1, 2, fd_) != 2 || magic[0] != 'P') {
+            return false;
+        }
+
+        long w, h;
+
+        switch (magic[1])
+        {
+            case '5':
+            case '6':
+            {
+                if (!token(fd_, w) || !token(fd_, h) || !token(fd_, maxval_)) {
+                    return false;
+                }
+
+                nchanns_ = (magic[1] == '5') ? 1 : 3;
+                break;
+            }
+
+            case '7':
+            {
+                type_ = steg::image::PAM;
+                if (!parse_pam()) {
+                    return false;
+                }
+
+                w = w_;
+                h = h_;
+                break;
+            }
+
+            default: {
+                return false; // ASCII or bitmap formats
+            }
+        }
+
+        if (w <= 0 || h <= 0 || maxval_ <= 0 || maxval_ > 65535) {
+            return false;
+        }
+
+        w_ = static_cast<int>(w);
+        h_ = static_cast<int>(h);
+        depth_ = (maxval_ > 255) ? 2 : 1;
+
+        // Pipes cannot seek
+        offset_ = std::ftell(fd_);
+        seekable_ = (offset_ >= 0) && (std::fseek(fd_, offset_, SEEK_SET) == 0);
+
+        return true;
+    }
+
+    /*! Parses a PAM header
+     */
+    bool pnm_input::parse_pam()
+    {
+        long w = 0, h = 0, depth = 0;
+
+        char line[256];
+        while (std::fgets(line, sizeof(line), fd_) != nullptr)
+        {
+            char key[32];
+            long value = 0;
+
+            if (line[0] == '#' || std::sscanf(line, "%31s", key) != 1) {
+                continue; // Comment, or blank line
+            }
+
+            if (::strcmp(key, "ENDHDR") == 0)
+            {
+                if (w <= 0 || h <= 0 || w > 0x7fffffff || h > 0x7fffffff || depth < 1 || depth > 4) {
+                    return false;
+                }
+
+                w_ = static_cast<int>(w);
+                h_ = static_cast<int>(h);
+                nchanns_ = static_cast<int>(depth);
+
+                return true;
+            }
+
+            // The tuple type follows from the depth
+            if (::strcmp(key, "TUPLTYPE") == 0) {
+                continue;
+            }
+
+            if (std::sscanf(line, "%*s %ld", &value) != 1) {
+                return false;
+            }
+
+            if (::strcmp(key, "WIDTH") == 0) {
+                w = value;
+            }
+
+            else if (::strcmp(key, "HEIGHT") == 0) {
+                h = value;
+            }
+
+            else if (::strcmp(key, "DEPTH") == 0) {
+                depth = value;
+            }
+
+            else if (::strcmp(key, "MAXVAL") == 0) {
+                maxval_ = value;
+            }
+        }
+
+        return false;
+    }
+
+    /*! Reads rows
+     */
+    bool pnm_input::read(unsigned char* rows, const int nrows)
+    {
+        const std::size_t size = static_cast<std::size_t>(w_) * nchanns_ * depth_;
+
+        for (int r = 0; r != nrows; ++r, rows += size, ++next_)
+        {
+            // Read before, from the cache
+            if (next_ < ncached_)
+            {
+                ::memcpy(rows, cache_.data() + (next_ * size), size);
+                continue;
+            }
+
+            if (std::fread(rows, 1, size, fd_) != size) {
+                return false;
+            }
+
+            if (depth_ == 2) {
+                swap16(rows, size);
+            }
+
+            if (seekable_) {
+                continue;
+            }
+
+            ++streamed_;
+
+            // Keep the first rows
+            if (next_ == ncached_ && (cache_.size() + size <= cache_size || ncached_ == 0))
+            {
+                cache_.insert(cache_.end(), rows, rows + size);
+                ++ncached_;
+            }
+        }
+
+        return true;
+    }
+
+    /*! Skips rows
+     */
+    bool pnm_input::skip(const int nrows)
+    {
+        if (!seekable_) {
+            return raster_reader::skip(nrows);
+        }
+
+        next_ += nrows;
+        return std::fseek(fd_, static_cast<long>(static_cast<std::size_t>(w_) * nchanns_ * depth_ * nrows), SEEK_CUR) == 0;
+    }
+
+    /*! Moves to a row
+     * Pipes can only go back to rows in the cache, and only while every row read is in it
+     */
+    bool pnm_input::seek(const int row)
+    {
+        if (!seekable_)
+        {
+            if (row > ncached_ || streamed_ != ncached_) {
+                return false;
+            }
+
+            next_ = row;
+            return true;
+        }
+
+        next_ = row;
+        return std::fseek(fd_, offset_ + static_cast<long>(static_cast<std::size_t>(w_) * nchanns_ * depth_ * row), SEEK_SET) == 0;
+    }
+
+    /*! Locates the pixels
+     */
+    bool pnm_input::map(steg::raster_map& map) const
+    {
+        // Saved with a maxval of 255, 8 bits per sample
+        if (!seekable_ || maxval_ != 255) {
+            return false;
+        }
+
+        map = { type_, offset_, static_cast<std::size_t>(w_) * nchanns_, nchanns_, { 0, 1, 2, 3 } };
+        return true;
+    }
+
+    /*! @class: writes binary PGM, PPM and PAM images, 8 or 16 bits per sample; PGM and PPM cannot hold alpha, those go as PAM
+     */
+    class pnm_output : public steg::raster_writer {
+    public:
+
+        inline pnm_output(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const steg::image::image_type type)
+            : raster_writer(fd, w, h, nchanns, false)
+            , type_(type) {
+            depth_ = depth;
+        }
+
+        /*! Writes the header
+         */
+        bool begin();
+
+        bool write(const unsigned char* rows, const int nrows) override;
+
+    private:
+
+        // PNM or PAM
+        steg::image::image_type type_;
+
+        // A row, big-endian; 16-bit samples only
+        std::vector<unsigned char> row_;
+    };
+
+    /*! Writes the header
+     */
+    bool pnm_output::begin()
+    {
+        const int maxval = (depth_ == 2) ? 65535 : 255;
+
+        if (type_ == steg::image::PNM && (nchanns_ == 1 || nchanns_ == 3)) {
+            return std::fprintf(fd_, "P%c\n%d %d\n%d\n", (nchanns_ == 1) ? '5' : '6', w_, h_, maxval) > 0;
+        }
+
+        return std::fprintf(fd_, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL %d\nTUPLTYPE %s\nENDHDR\n", w_, h_, nchanns_, maxval, tuple_types[nchanns_]) > 0;
+    }
+
+    /*! Writes rows
+     */
+    bool pnm_output::write(const unsigned char* rows, const int nrows)
+    {
+        if (depth_ == 1)
+        {
+            const std::size_t size = static_cast<std::size_t>(w_) * nchanns_ * nrows;
+            return std::fwrite(rows, 1, size, fd_) == size;
+        }
+
+        // 16-bit samples go big-endian, a row at a time
+        const std::size_t size = static_cast<std::size_t>(w_) * nchanns_ * 2;
+        row_.resize(size);
+
+        for (int r = 0; r != nrows; ++r, rows += size)
+        {
+            for (std::size_t i = 0; i != size; i += 2)
+            {
+                std::uint16_t sample;
+                ::memcpy(&sample, rows + i, 2);
+                row_[i] = static_cast<unsigned char>(sample >> 8);
+                row_[i + 1] = static_cast<unsigned char>(sample & 0xff);
+            }
+
+            if (std::fwrite(row_.data(), 1, size, fd_) != size) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/*! PNM/PAM reader
+ */
+steg::raster_reader* steg::pnm_reader(std::FILE* fd)
+{
+    pnm_input* reader = new pnm_input(fd);
+    if (!reader->parse()) {
+        return (delete reader, nullptr);
+    }
+
+    return reader;
+}
+
+/*! PNM/PAM writer
+ */
+steg::raster_writer* steg::pnm_writer(std::FILE* fd, const int w, const int h, const int nchanns, const int depth, const image::image_type type)
+{
+    pnm_output* writer = new pnm_output(fd, w, h, nchanns, depth, type);
+    if (!writer->begin()) {
+        return (delete writer, nullptr);
+    }
+
+    return writer;
+}
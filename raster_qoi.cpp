@@ -0,0 +1,420 @@
+/* raster_qoi.cpp -- v1.0 -- reads and writes QOI ("Quite OK Image") images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "raster.hpp"
+
+namespace {
+    /*! Helper
+     * Big-endian integers
+     */
+    inline std::uint32_t load32(const unsigned char* p) {
+        return (static_cast<std::uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    inline void store32(unsigned char* p, const std::uint32_t value) {
+        p[0] = (value >> 24) & 0xff;
+        p[1] = (value >> 16) & 0xff;
+        p[2] = (value >> 8) & 0xff;
+        p[3] = value & 0xff;
+    }
+
+    const std::size_t header_size = 14;
+
+    // Ends the stream
+    const unsigned char trailer[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+    // Ops; the two-bit tags are in the high bits of the first byte
+    const int op_index = 0x00;
+    const int op_diff = 0x40;
+    const int op_luma = 0x80;
+    const int op_run = 0xc0;
+    const int op_rgb = 0xfe;
+    const int op_rgba = 0xff;
+    const int tag_mask = 0xc0;
+
+    // Longest run; 63 and 64 would clash with op_rgb and op_rgba
+    const int max_run = 62;
+
+    // Longest op, in bytes
+    const std::size_t max_op = 5;
+
+    // Pixel limit of the reference implementation
+    const std::uint64_t max_pixels = 400000000;
+
+    /*! @class: an RGBA pixel
+     */
+    struct pixel {
+        unsigned char rgba[4];
+
+        inline bool operator==(const pixel& other) const {
+            return ::memcmp(rgba, other.rgba, 4) == 0;
+        }
+
+        /*! Slot of the pixel in the table of recently seen pixels
+         */
+        inline int hash() const {
+            return ((rgba[0] * 3) + (rgba[1] * 5) + (rgba[2] * 7) + (rgba[3] * 11)) % 64;
+        }
+    };
+
+    /*! @class: reads QOI images, RGB or RGBA
+     */
+    class qoi_input : public steg::raster_reader {
+    public:
+
+        inline explicit qoi_input(std::FILE* fd) : raster_reader(fd), left_(0), run_(0), buff_(64 * 1024), pos_(0), end_(0) {
+            ::memset(index_, 0, sizeof(index_));
+            prev_ = { { 0, 0, 0, 255 } };
+        }
+
+        /*! Parses the header, leaves the file at the first row
+         */
+        bool parse();
+
+        bool read(unsigned char* rows, const int nrows) override;
+
+    private:
+
+        /*! Ensures the next op is buffered whole, unless the file ends first
+         * @return    false if no byte is left
+         */
+        bool fill();
+
+        // Pixels left to decode
+        std::uint64_t left_;
+
+        // Repeats of prev_ still due
+        int run_;
+
+        // Last pixel, and recently seen pixels
+        pixel prev_;
+        pixel index_[64];
+
+        // Read buffer, and the unread bytes in it
+        std::vector<unsigned char> buff_;
+        std::size_t pos_;
+        std::size_t end_;
+    };
+
+    /*! Parses the header
+     */
+    bool qoi_input::parse()
+    {
+        unsigned char hdr[header_size];
+        if (std::fread(hdr, 1, header_size, fd_) != header_size || ::memcmp(hdr, "qoif", 4) != 0) {
+            return false;
+        }
+
+        const std::uint32_t w = load32(hdr + 4);
+        const std::uint32_t h = load32(hdr + 8);
+        nchanns_ = hdr[12];
+
+        if (w == 0 || h == 0 || w > 0x7fffffff || h > 0x7fffffff || (static_cast<std::uint64_t>(w) * h) > max_pixels) {
+            return false;
+        }
+
+        if (nchanns_ != 3 && nchanns_ != 4) {
+            return false;
+        }
+
+        w_ = static_cast<int>(w);
+        h_ = static_cast<int>(h);
+        left_ = static_cast<std::uint64_t>(w) * h;
+
+        return true;
+    }
+
+    /*! Refills the buffer
+     */
+    bool qoi_input::fill()
+    {
+        if ((end_ - pos_) < max_op)
+        {
+            ::memmove(buff_.data(), buff_.data() + pos_, end_ - pos_);
+            end_ -= pos_;
+            pos_ = 0;
+            end_ += std::fread(buff_.data() + end_, 1, buff_.size() - end_, fd_);
+        }
+
+        return pos_ != end_;
+    }
+
+    /*! Reads rows
+     */
+    bool qoi_input::read(unsigned char* rows, const int nrows)
+    {
+        const std::uint64_t npixels = static_cast<std::uint64_t>(w_) * nrows;
+        if (npixels > left_) {
+            return false;
+        }
+
+        pixel px = prev_;
+
+        for (std::uint64_t i = 0; i != npixels; ++i, rows += nchanns_)
+        {
+            if (run_ != 0) {
+                --run_;
+            }
+
+            else
+            {
+                if (!fill()) {
+                    return false;
+                }
+
+                const unsigned char* in = buff_.data() + pos_;
+                const int op = in[0];
+
+                // Bytes the op takes
+                const std::size_t size = (op == op_rgba) ? 5 : (op == op_rgb) ? 4 : ((op & tag_mask) == op_luma) ? 2 : 1;
+                if ((end_ - pos_) < size) {
+                    return false;
+                }
+
+                pos_ += size;
+
+                if (op == op_rgb) {
+                    ::memcpy(px.rgba, in + 1, 3);
+                }
+
+                else if (op == op_rgba) {
+                    ::memcpy(px.rgba, in + 1, 4);
+                }
+
+                else
+                {
+                    switch (op & tag_mask)
+                    {
+                        case op_index: {
+                            px = index_[op];
+                            break;
+                        }
+
+                        case op_diff:
+                        {
+                            px.rgba[0] += ((op >> 4) & 3) - 2;
+                            px.rgba[1] += ((op >> 2) & 3) - 2;
+                            px.rgba[2] += (op & 3) - 2;
+                            break;
+                        }
+
+                        case op_luma:
+                        {
+                            const int dg = (op & 0x3f) - 32;
+                            px.rgba[0] += dg - 8 + ((in[1] >> 4) & 0x0f);
+                            px.rgba[1] += dg;
+                            px.rgba[2] += dg - 8 + (in[1] & 0x0f);
+                            break;
+                        }
+
+                        default: {
+                            run_ = op & 0x3f; // > this pixel, then run_ more
+                            break;
+                        }
+                    }
+                }
+
+                index_[px.hash()] = px;
+            }
+
+            ::memcpy(rows, px.rgba, nchanns_);
+        }
+
+        prev_ = px;
+        left_ -= npixels;
+
+        return true;
+    }
+
+    /*! @class: writes QOI images, RGB or RGBA; grey images are widened, like stbi_write_bmp does
+     */
+    class qoi_output : public steg::raster_writer {
+    public:
+
+        inline qoi_output(std::FILE* fd, const int w, const int h, const int nchanns)
+            : raster_writer(fd, w, h, nchanns, false)
+            , left_(static_cast<std::uint64_t>(w) * h)
+            , run_(0)
+            , out_(static_cast<std::size_t>(w) * max_op) {
+            ::memset(index_, 0, sizeof(index_));
+            prev_ = { { 0, 0, 0, 255 } };
+        }
+
+        /*! Writes the header
+         */
+        bool begin();
+
+        bool write(const unsigned char* rows, const int nrows) override;
+
+    private:
+
+        bool finish() override;
+
+        // Pixels left to encode
+        std::uint64_t left_;
+
+        // Repeats of prev_ not yet written
+        int run_;
+
+        // Last pixel, and recently seen pixels
+        pixel prev_;
+        pixel index_[64];
+
+        // One row, encoded
+        std::vector<unsigned char> out_;
+    };
+
+    /*! Writes the header
+     */
+    bool qoi_output::begin()
+    {
+        unsigned char hdr[header_size];
+        ::memcpy(hdr, "qoif", 4);
+        store32(hdr + 4, static_cast<std::uint32_t>(w_));
+        store32(hdr + 8, static_cast<std::uint32_t>(h_));
+        hdr[12] = (nchanns_ == 2 || nchanns_ == 4) ? 4 : 3;
+        hdr[13] = 0; // > sRGB with linear alpha
+
+        return std::fwrite(hdr, 1, header_size, fd_) == header_size;
+    }
+
+    /*! Writes rows
+     * Runs may span rows, they are cut at the last pixel of the image
+     */
+    bool qoi_output::write(const unsigned char* rows, const int nrows)
+    {
+        const int c = nchanns_;
+
+        if ((static_cast<std::uint64_t>(w_) * nrows) > left_) {
+            return false;
+        }
+
+        for (int r = 0; r != nrows; ++r)
+        {
+            unsigned char* out = out_.data();
+
+            for (int x = 0; x != w_; ++x, rows += c)
+            {
+                pixel px;
+                switch (c)
+                {
+                    case 1: { px = { { rows[0], rows[0], rows[0], 255 } }; break; }
+                    case 2: { px = { { rows[0], rows[0], rows[0], rows[1] } }; break; }
+                    case 3: { px = { { rows[0], rows[1], rows[2], 255 } }; break; }
+                    default: { px = { { rows[0], rows[1], rows[2], rows[3] } }; break; }
+                }
+
+                --left_;
+
+                if (px == prev_)
+                {
+                    if (++run_ == max_run || left_ == 0) {
+                        *out++ = static_cast<unsigned char>(op_run | (run_ - 1));
+                        run_ = 0;
+                    }
+
+                    continue;
+                }
+
+                if (run_ != 0) {
+                    *out++ = static_cast<unsigned char>(op_run | (run_ - 1));
+                    run_ = 0;
+                }
+
+                const int slot = px.hash();
+
+                if (index_[slot] == px) {
+                    *out++ = static_cast<unsigned char>(op_index | slot);
+                }
+
+                else
+                {
+                    index_[slot] = px;
+
+                    if (px.rgba[3] == prev_.rgba[3])
+                    {
+                        const int dr = static_cast<signed char>(px.rgba[0] - prev_.rgba[0]);
+                        const int dg = static_cast<signed char>(px.rgba[1] - prev_.rgba[1]);
+                        const int db = static_cast<signed char>(px.rgba[2] - prev_.rgba[2]);
+                        const int dr_dg = dr - dg;
+                        const int db_dg = db - dg;
+
+                        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                            *out++ = static_cast<unsigned char>(op_diff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                        }
+
+                        else if (dr_dg >= -8 && dr_dg <= 7 && dg >= -32 && dg <= 31 && db_dg >= -8 && db_dg <= 7)
+                        {
+                            *out++ = static_cast<unsigned char>(op_luma | (dg + 32));
+                            *out++ = static_cast<unsigned char>(((dr_dg + 8) << 4) | (db_dg + 8));
+                        }
+
+                        else
+                        {
+                            *out++ = static_cast<unsigned char>(op_rgb);
+                            ::memcpy(out, px.rgba, 3);
+                            out += 3;
+                        }
+                    }
+
+                    else
+                    {
+                        *out++ = static_cast<unsigned char>(op_rgba);
+                        ::memcpy(out, px.rgba, 4);
+                        out += 4;
+                    }
+                }
+
+                prev_ = px;
+            }
+
+            const std::size_t size = out - out_.data();
+            if (std::fwrite(out_.data(), 1, size, fd_) != size) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*! Writes the end marker
+     */
+    bool qoi_output::finish()
+    {
+        // Every pixel must have been written
+        if (left_ != 0) {
+            return false;
+        }
+
+        return std::fwrite(trailer, 1, sizeof(trailer), fd_) == sizeof(trailer);
+    }
+}
+
+/*! QOI reader
+ */
+steg::raster_reader* steg::qoi_reader(std::FILE* fd)
+{
+    qoi_input* reader = new qoi_input(fd);
+    if (!reader->parse()) {
+        return (delete reader, nullptr);
+    }
+
+    return reader;
+}
+
+/*! QOI writer
+ */
+steg::raster_writer* steg::qoi_writer(std::FILE* fd, const int w, const int h, const int nchanns)
+{
+    qoi_output* writer = new qoi_output(fd, w, h, nchanns);
+    if (!writer->begin()) {
+        return (delete writer, nullptr);
+    }
+
+    return writer;
+}
@@ -0,0 +1,425 @@
+/* raster_tga.cpp -- v1.0 -- reads and writes true-colour and greyscale TGA images a few rows at a time
+   Author: Sam Y. 2021 */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "raster.hpp"
+
+namespace {
+    /*! Helper
+     * Little-endian integers
+     */
+    inline int load16(const unsigned char* p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    inline void store16(unsigned char* p, const int value) {
+        p[0] = value & 0xff;
+        p[1] = (value >> 8) & 0xff;
+    }
+
+    const std::size_t header_size = 18;
+
+    // Image types
+    const int true_color = 2;
+    const int grey = 3;
+    const int rle = 8; // > added to either
+
+    /*! Helper
+     * Converts pixels between file order (BGR(A), or grey + alpha) and stb order (RGB(A), or grey + alpha)
+     */
+    inline void swizzle(const unsigned char* in, unsigned char* out, const int npixels, const int nchanns) {
+        if (nchanns < 3) {
+            ::memcpy(out, in, static_cast<std::size_t>(npixels) * nchanns);
+            return;
+        }
+
+        for (int x = 0; x != npixels; ++x, in += nchanns, out += nchanns)
+        {
+            out[0] = in[2];
+            out[1] = in[1];
+            out[2] = in[0];
+            if (nchanns == 4) {
+                out[3] = in[3];
+            }
+        }
+    }
+
+    /*! @class: reads uncompressed and run-length encoded TGA images, true-colour or greyscale
+     */
+    class tga_input : public steg::raster_reader {
+    public:
+
+        inline explicit tga_input(std::FILE* fd) : raster_reader(fd), rle_(false), offset_(0), run_(0), repeat_(false), next_(0) {  }
+
+        /*! Parses the header, leaves the file at the first row
+         */
+        bool parse();
+
+        bool read(unsigned char* rows, const int nrows) override;
+        bool skip(const int nrows) override;
+        bool seek(const int row) override;
+        bool map(steg::raster_map& map) const override;
+
+    private:
+
+        /*! Decodes the next row of a run-length encoded image, in file order
+         */
+        bool unpack(unsigned char* row);
+
+        // Run-length encoded
+        bool rle_;
+
+        // Offset of the first row
+        long offset_;
+
+        // Pixels left in the current packet, and whether they repeat pixel_
+        int run_;
+        bool repeat_;
+        unsigned char pixel_[4];
+
+        /*! @class: decoder state at the start of a row
+         */
+        struct mark {
+            long offset;
+            int run;
+            bool repeat;
+            unsigned char pixel[4];
+        };
+
+        // Next row, and where each row decoded so far starts (run-length encoded images)
+        int next_;
+        std::vector<mark> marks_;
+
+        // One row, in file order
+        std::vector<unsigned char> row_;
+    };
+
+    /*! Parses the header
+     */
+    bool tga_input::parse()
+    {
+        unsigned char hdr[header_size];
+        if (std::fread(hdr, 1, header_size, fd_) != header_size) {
+            return false;
+        }
+
+        const int idlen = hdr[0];
+        const int cmaptype = hdr[1];
+        const int type = hdr[2];
+        const int cmaplen = load16(hdr + 5);
+        const int cmapbits = hdr[7];
+        const int bpp = hdr[16];
+
+        if (cmaptype > 1) {
+            return false;
+        }
+
+        rle_ = (type & rle) != 0;
+
+        // Pixel layouts stbi_load returns as-is
+        switch (type & ~rle)
+        {
+            case true_color: {
+                nchanns_ = (bpp == 24) ? 3 : (bpp == 32) ? 4 : 0;
+                break;
+            }
+
+            case grey: {
+                nchanns_ = (bpp == 8) ? 1 : (bpp == 16) ? 2 : 0;
+                break;
+            }
+
+            default: {
+                nchanns_ = 0; // Colour-mapped, or not a TGA image
+                break;
+            }
+        }
+
+        w_ = load16(hdr + 12);
+        h_ = load16(hdr + 14);
+        bottomUp_ = (hdr[17] & 0x20) == 0;
+
+        if (nchanns_ == 0 || w_ == 0 || h_ == 0) {
+            return false;
+        }
+
+        row_.resize(static_cast<std::size_t>(w_) * nchanns_);
+
+        // Skip the image id, and an unused colour map
+        offset_ = static_cast<long>(header_size) + idlen + ((cmaptype != 0) ? (cmaplen * ((cmapbits + 7) / 8)) : 0);
+        marks_.push_back({ offset_, 0, false, {  } });
+
+        return std::fseek(fd_, offset_, SEEK_SET) == 0;
+    }
+
+    /*! Decodes a row
+     */
+    bool tga_input::unpack(unsigned char* row)
+    {
+        for (int x = 0; x != w_; )
+        {
+            // Next packet
+            if (run_ == 0)
+            {
+                const int header = std::fgetc(fd_);
+                if (header == EOF) {
+                    return false;
+                }
+
+                run_ = (header & 0x7f) + 1;
+                repeat_ = (header & 0x80) != 0;
+
+                if (repeat_ && std::fread(pixel_, 1, nchanns_, fd_) != static_cast<std::size_t>(nchanns_)) {
+                    return false;
+                }
+            }
+
+            // Packets may span rows
+            const int n = (run_ < (w_ - x)) ? run_ : (w_ - x);
+            unsigned char* out = row + (static_cast<std::size_t>(x) * nchanns_);
+
+            if (repeat_) {
+                for (int i = 0; i != n; ++i, out += nchanns_) {
+                    ::memcpy(out, pixel_, nchanns_);
+                }
+            }
+
+            else if (std::fread(out, nchanns_, n, fd_) != static_cast<std::size_t>(n)) {
+                return false;
+            }
+
+            run_ -= n;
+            x += n;
+        }
+
+        return true;
+    }
+
+    /*! Reads rows
+     */
+    bool tga_input::read(unsigned char* rows, const int nrows)
+    {
+        const std::size_t size = row_.size();
+
+        for (int r = 0; r != nrows; ++r, rows += size)
+        {
+            // Remember where the row starts, for seek()
+            if (rle_ && static_cast<std::size_t>(next_) == marks_.size())
+            {
+                mark m = { std::ftell(fd_), run_, repeat_, {  } };
+                ::memcpy(m.pixel, pixel_, sizeof(pixel_));
+                marks_.push_back(m);
+            }
+
+            if (rle_ ? !unpack(row_.data()) : (std::fread(row_.data(), 1, size, fd_) != size)) {
+                return false;
+            }
+
+            swizzle(row_.data(), rows, w_, nchanns_);
+            ++next_;
+        }
+
+        return true;
+    }
+
+    /*! Skips rows
+     */
+    bool tga_input::skip(const int nrows)
+    {
+        if (rle_) {
+            return raster_reader::skip(nrows);
+        }
+
+        next_ += nrows;
+        return std::fseek(fd_, static_cast<long>(row_.size() * nrows), SEEK_CUR) == 0;
+    }
+
+    /*! Moves to a row
+     * Packets of run-length encoded images are only found by decoding the rows before them;
+     * rows decoded once are returned to directly
+     */
+    bool tga_input::seek(const int row)
+    {
+        if (rle_)
+        {
+            const mark& m = marks_[std::min<std::size_t>(row, marks_.size() - 1)];
+            if (std::fseek(fd_, m.offset, SEEK_SET) != 0) {
+                return false;
+            }
+
+            run_ = m.run;
+            repeat_ = m.repeat;
+            ::memcpy(pixel_, m.pixel, sizeof(pixel_));
+            next_ = std::min<int>(row, static_cast<int>(marks_.size()) - 1);
+
+            return skip(row - next_);
+        }
+
+        next_ = row;
+        return std::fseek(fd_, offset_ + static_cast<long>(row_.size() * row), SEEK_SET) == 0;
+    }
+
+    /*! Locates the pixels
+     */
+    bool tga_input::map(steg::raster_map& map) const
+    {
+        if (rle_) {
+            return false;
+        }
+
+        map = { steg::image::TGA, offset_, row_.size(), nchanns_, { 0, 1, 2, 3 } };
+
+        // BGR(A) to RGB(A)
+        if (nchanns_ >= 3)
+        {
+            map.order[0] = 2;
+            map.order[2] = 0;
+        }
+
+        return true;
+    }
+
+    /*! @class: writes run-length encoded TGA images, byte for byte like stbi_write_tga
+     */
+    class tga_output : public steg::raster_writer {
+    public:
+
+        inline tga_output(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp)
+            : raster_writer(fd, w, h, nchanns, bottomUp)
+            , row_(static_cast<std::size_t>(w) * nchanns)
+            , out_((static_cast<std::size_t>(w) * (nchanns + 1)) + 1) {  }
+
+        /*! Writes the header
+         */
+        bool begin();
+
+        bool write(const unsigned char* rows, const int nrows) override;
+
+    private:
+
+        // One row, in file order
+        std::vector<unsigned char> row_;
+
+        // One row, encoded
+        std::vector<unsigned char> out_;
+    };
+
+    /*! Writes the header
+     */
+    bool tga_output::begin()
+    {
+        const bool alpha = (nchanns_ == 2 || nchanns_ == 4);
+
+        unsigned char hdr[header_size] = {  };
+        hdr[2] = ((nchanns_ < 3) ? grey : true_color) + rle;
+        store16(hdr + 12, w_);
+        store16(hdr + 14, h_);
+        hdr[16] = nchanns_ * 8;
+        hdr[17] = (alpha ? 8 : 0) | (bottomUp_ ? 0 : 0x20); // > alpha bits, top-down origin
+
+        return std::fwrite(hdr, 1, header_size, fd_) == header_size;
+    }
+
+    /*! Writes rows
+     * Packets never span rows; a raw packet ends where two equal pixels start a run
+     */
+    bool tga_output::write(const unsigned char* rows, const int nrows)
+    {
+        const int c = nchanns_;
+
+        for (int r = 0; r != nrows; ++r, rows += row_.size())
+        {
+            swizzle(rows, row_.data(), w_, c);
+
+            const unsigned char* const row = row_.data();
+            unsigned char* out = out_.data();
+
+            for (int i = 0, len; i < w_; i += len)
+            {
+                const unsigned char* const begin = row + (i * c);
+                bool diff = true;
+                len = 1;
+
+                if (i < (w_ - 1))
+                {
+                    ++len;
+                    diff = ::memcmp(begin, row + ((i + 1) * c), c) != 0;
+
+                    if (diff)
+                    {
+                        const unsigned char* prev = begin;
+                        for (int k = i + 2; k < w_ && len < 128; ++k)
+                        {
+                            if (::memcmp(prev, row + (k * c), c) != 0) {
+                                prev += c;
+                                ++len;
+                            }
+
+                            else {
+                                --len;
+                                break;
+                            }
+                        }
+                    }
+
+                    else
+                    {
+                        for (int k = i + 2; k < w_ && len < 128 && ::memcmp(begin, row + (k * c), c) == 0; ++k) {
+                            ++len;
+                        }
+                    }
+                }
+
+                if (diff)
+                {
+                    *out++ = static_cast<unsigned char>(len - 1);
+                    ::memcpy(out, begin, len * c);
+                    out += (len * c);
+                }
+
+                else
+                {
+                    *out++ = static_cast<unsigned char>(len + 127);
+                    ::memcpy(out, begin, c);
+                    out += c;
+                }
+            }
+
+            const std::size_t size = out - out_.data();
+            if (std::fwrite(out_.data(), 1, size, fd_) != size) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+/*! TGA reader
+ */
+steg::raster_reader* steg::tga_reader(std::FILE* fd)
+{
+    tga_input* reader = new tga_input(fd);
+    if (!reader->parse()) {
+        return (delete reader, nullptr);
+    }
+
+    return reader;
+}
+
+/*! TGA writer
+ */
+steg::raster_writer* steg::tga_writer(std::FILE* fd, const int w, const int h, const int nchanns, const bool bottomUp)
+{
+    tga_output* writer = new tga_output(fd, w, h, nchanns, bottomUp);
+    if (!writer->begin()) {
+        return (delete writer, nullptr);
+    }
+
+    return writer;
+}
@@ -0,0 +1,99 @@
+/* scatter.cpp -- v1.0 -- keyed placement of message cells over the image
+   Author: Sam Y. 2021 */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "scatter.hpp"
+
+namespace {
+    /*! Helper
+     * splitmix64 step, expands a seed into a sequence of well-mixed values
+     */
+    inline std::uint64_t next(std::uint64_t& state) {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+}
+
+/*! ctor.
+ */
+steg::scatter::permutation::permutation(const std::size_t n, std::uint64_t seed) : size(n)
+{
+    int nbits = 0;
+    while ((static_cast<std::size_t>(1) << nbits) < n) {
+        ++nbits;
+    }
+
+    mask = (static_cast<std::size_t>(1) << nbits) - 1;
+    shift = (nbits + 1) / 2;
+
+    for (int r = 0; r != rounds; ++r)
+    {
+        mul[r] = next(seed) | 1; // > odd, so a bijection modulo a power of 2
+        add[r] = next(seed);
+    }
+}
+
+/*! ctor.
+ */
+steg::scatter::scatter() : ncells_(0)
+                         , ntiles_(0)
+                         , seed_(0)
+                         , tiles_(0, 0) {  }
+
+/*! ctor.
+ */
+steg::scatter::scatter(const std::size_t ncells, const std::uint64_t seed) : ncells_(ncells)
+                                                                           , ntiles_(ncells / tile_cells)
+                                                                           , seed_(seed)
+                                                                           , tiles_(ncells / tile_cells, seed) {  }
+
+/*! Physical cell index
+ */
+std::size_t steg::scatter::map(const std::size_t i) const
+{
+    const std::size_t tile = i / tile_cells;
+    return (place(tile) * tile_cells) + cells_of(tile)(i % tile_cells);
+}
+
+/*! Copies cells, in logical order
+ */
+void steg::scatter::gather(const unsigned char* data, const int stride, const std::size_t first, const std::size_t n, unsigned char* out) const
+{
+    const std::size_t tile = first / tile_cells;
+    const permutation cells = cells_of(tile);
+
+    data += (stride * place(tile) * tile_cells);
+    for (std::size_t i = first % tile_cells, j = 0; j != n; ++i, ++j) {
+        out[j] = data[stride * cells(i)];
+    }
+}
+
+/*! Copies cells back
+ */
+void steg::scatter::put(unsigned char* data, const int stride, const std::size_t first, const std::size_t n, const unsigned char* in) const
+{
+    const std::size_t tile = first / tile_cells;
+    const permutation cells = cells_of(tile);
+
+    data += (stride * place(tile) * tile_cells);
+    for (std::size_t i = first % tile_cells, j = 0; j != n; ++i, ++j) {
+        data[stride * cells(i)] = in[j];
+    }
+}
+
+/*! Permutation of the cells within a tile
+ */
+steg::scatter::permutation steg::scatter::cells_of(const std::size_t tile) const
+{
+    // Every tile gets its own key
+    std::uint64_t state = seed_ ^ ((tile + 1) * 0xd6e8feb86659fd93ull);
+    const std::uint64_t seed = next(state);
+
+    // Only the trailing partial tile is shorter
+    const std::size_t size = (tile < ntiles_) ? tile_cells : (ncells_ - (tile * tile_cells));
+    return permutation(size, seed);
+}
@@ -0,0 +1,96 @@
+/* scatter.hpp -- v1.0 -- keyed placement of message cells over the image
+   Author: Sam Y. 2021 */
+
+#ifndef _SCATTER_HPP
+#define _SCATTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace steg {
+    /// @class scatter
+    /// Keyed permutation of the cells of an image, computed on the fly
+    /// Cells are split into tiles of tile_cells; the order of the whole tiles is permuted, then
+    /// the cells within each tile. Tiles are small enough to stay in cache, so visiting the
+    /// cells of a tile in permuted order costs about as much as a sequential scan
+    class scatter {
+    public:
+
+        /// No. of cells per tile, a power of 2 (and a multiple of 8, so tiles start on whole message bytes)
+        static const std::size_t tile_cells = 8192;
+
+        /// ctor.
+        scatter();
+
+        /// ctor.
+        /// @param ncells    no. of cells
+        /// @param seed      key-derived seed
+        scatter(const std::size_t ncells, const std::uint64_t seed);
+
+        /// @param i    logical cell index
+        /// @return     physical cell index
+        std::size_t map(const std::size_t i) const;
+
+        /// Copies cells into a contiguous buffer, in logical order
+        /// @param data      first cell of the image [in]
+        /// @param stride    distance between cells, in bytes
+        /// @param first     first logical cell
+        /// @param n         no. of cells; [first, first + n) must not cross a tile boundary
+        /// @param out       output buffer, at least n bytes [out]
+        void gather(const unsigned char* data, const int stride, const std::size_t first, const std::size_t n, unsigned char* out) const;
+
+        /// Copies a contiguous buffer back to cells, the inverse of gather
+        /// @param data      first cell of the image [in/out]
+        /// @param stride    distance between cells, in bytes
+        /// @param first     first logical cell
+        /// @param n         no. of cells; [first, first + n) must not cross a tile boundary
+        /// @param in        input buffer, at least n bytes [in]
+        void put(unsigned char* data, const int stride, const std::size_t first, const std::size_t n, const unsigned char* in) const;
+
+    private:
+
+        /*! @class: keyed bijection over [0, size)
+         * A few rounds of multiply-add and xorshift over the smallest power-of-2 domain that
+         * holds size; values that fall outside of [0, size) go through again (cycle walking)
+         */
+        struct permutation {
+
+            permutation(const std::size_t size, std::uint64_t seed);
+
+            inline std::size_t operator()(std::size_t x) const {
+                do {
+                    for (int r = 0; r != rounds; ++r) {
+                        x = ((x * mul[r]) + add[r]) & mask;
+                        x ^= (x >> shift);
+                    }
+                } while (x >= size);
+                return x;
+            }
+
+            static const int rounds = 3;
+
+            std::uint64_t mul[rounds], add[rounds];
+            std::size_t size, mask;
+            int shift;
+        };
+
+        /*! Helper
+         * Permutation of the cells within a tile
+         */
+        permutation cells_of(const std::size_t tile) const;
+
+        /*! Helper
+         * Physical index of a tile; the trailing partial tile, if any, stays in place
+         */
+        inline std::size_t place(const std::size_t tile) const {
+            return (tile < ntiles_) ? tiles_(tile) : tile;
+        }
+
+        std::size_t ncells_;
+        std::size_t ntiles_;  // > no. of whole tiles
+        std::uint64_t seed_;
+        permutation tiles_;   // > order of whole tiles
+    };
+}
+
+#endif
@@ -0,0 +1,90 @@
+/* thread_pool.cpp -- v1.0 -- fixed-size pool of worker threads
+   Author: Sam Y. 2021 */
+
+#include "thread_pool.hpp"
+
+/*! dtor.
+ */
+steg::thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+/*! ctor.
+ */
+steg::thread_pool::thread_pool(const unsigned int nthreads) : task_(nullptr)
+                                                            , ntasks_(0)
+                                                            , next_(0)
+                                                            , pending_(0)
+                                                            , stop_(false)
+{
+    // The caller of run() is a thread too
+    for (unsigned int i = 1; i < nthreads; ++i) {
+        workers_.emplace_back(&thread_pool::work, this);
+    }
+}
+
+/*! Runs tasks
+ */
+void steg::thread_pool::run(const std::size_t ntasks, const std::function<void(const std::size_t)>& task)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    task_ = &task;
+    ntasks_ = ntasks;
+    next_ = 0;
+    pending_ = ntasks;
+
+    wake_.notify_all();
+
+    // Lend a hand, then wait for the stragglers
+    drain(lock);
+    done_.wait(lock, [this] { return pending_ == 0; });
+
+    task_ = nullptr;
+}
+
+/*! Worker thread body
+ */
+void steg::thread_pool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true)
+    {
+        wake_.wait(lock, [this] { return stop_ || next_ != ntasks_; });
+
+        if (stop_) {
+            return;
+        }
+
+        drain(lock);
+    }
+}
+
+/*! Runs tasks until there are none left
+ */
+void steg::thread_pool::drain(std::unique_lock<std::mutex>& lock)
+{
+    while (next_ != ntasks_)
+    {
+        const std::size_t i = next_++;
+        const std::function<void(const std::size_t)>& task = *task_;
+
+        lock.unlock();
+        task(i);
+        lock.lock();
+
+        if (--pending_ == 0) {
+            done_.notify_all();
+        }
+    }
+}
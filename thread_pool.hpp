@@ -0,0 +1,66 @@
+/* thread_pool.hpp -- v1.0 -- fixed-size pool of worker threads
+   Author: Sam Y. 2021 */
+
+#ifndef _THREAD_POOL_HPP
+#define _THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace steg {
+    /// @class thread_pool
+    class thread_pool {
+    public:
+
+        /// dtor.
+        ~thread_pool();
+
+        /// ctor.
+        /// @param nthreads    no. of threads that run tasks, including the caller of run()
+        explicit thread_pool(const unsigned int nthreads);
+
+        /// @return    no. of threads that run tasks, including the caller of run()
+        inline unsigned int size() const {
+            return workers_.size() + 1;
+        }
+
+        /// Runs task(i) for every i in [0, ntasks), returns when all are done
+        /// Tasks are picked up in order; must not be called from within a task
+        /// @param ntasks    no. of tasks
+        /// @param task      task body
+        void run(const std::size_t ntasks, const std::function<void(const std::size_t)>& task);
+
+    private:
+
+        /*! Worker thread body
+         */
+        void work();
+
+        /*! Runs tasks until there are none left, expects the lock to be held
+         */
+        void drain(std::unique_lock<std::mutex>& lock);
+
+        // Non-copyable
+        explicit thread_pool(thread_pool&) = delete;
+        explicit thread_pool(const thread_pool&) = delete;
+
+        std::vector<std::thread> workers_;
+
+        std::mutex mutex_;
+        std::condition_variable wake_; // > signals new tasks, or shutdown
+        std::condition_variable done_; // > signals that the last task completed
+
+        // Current batch of tasks
+        const std::function<void(const std::size_t)>* task_;
+        std::size_t ntasks_;
+        std::size_t next_;    // > next task to pick up
+        std::size_t pending_; // > tasks not yet completed
+
+        bool stop_;
+    };
+}
+
+#endif
@@ -0,0 +1,741 @@
+/* tiled_image.cpp -- v1.0 -- reads and writes a message to a source image one band of rows at a time
+   Author: Sam Y. 2021 */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include <sys/stat.h>
+
+#include "checksum.hpp"
+#include "error.hpp"
+#include "header.hpp"
+#include "lsb.hpp"
+#include "mapped_file.hpp"
+#include "raster.hpp"
+#include "thread_pool.hpp"
+#include "tiled_image.hpp"
+
+namespace {
+    // Bytes of image data per band
+    const std::size_t band_size = 4 * 1024 * 1024;
+
+    // No terminator
+    const std::size_t npos = static_cast<std::size_t>(-1);
+
+    /*! Helper
+     * Rounds up to a multiple of 8 cells; message bytes start afresh there, whatever the no. of bits per cell
+     */
+    inline std::size_t align(const std::size_t cell) {
+        return (cell + 7) & ~static_cast<std::size_t>(7);
+    }
+
+    /*! Helper
+     * Embeds cells [lo, hi) of a message one bit at a time, data is cell lo; bits past the message are zero
+     */
+    void put(unsigned char* data, const int stride, const int bits, const bool flag, const char* buff, const std::size_t size, std::size_t lo, const std::size_t hi)
+    {
+        // Clears the message bits, and the flag bit above them
+        const unsigned int keep = ~(((flag ? 2u : 1u) << bits) - 1);
+
+        for ( ; lo != hi; ++lo, data += stride)
+        {
+            unsigned int value = 0;
+            for (int b = 0; b != bits; ++b)
+            {
+                const std::size_t k = (lo * bits) + b;
+                if ((k / 8) < size) {
+                    value |= (((static_cast<unsigned char>(buff[k / 8]) >> (k % 8)) & 1u) << b);
+                }
+            }
+
+            *data = ((*data & keep) | value);
+        }
+    }
+
+    /*! Helper
+     * Extracts cells [lo, hi) of a message one bit at a time, data is cell lo; bits past the buffer are dropped
+     * @return    the terminator's cell, or npos
+     */
+    std::size_t get(const unsigned char* data, const int stride, const int bits, const bool flag, char* buff, const std::size_t size, std::size_t lo, const std::size_t hi)
+    {
+        // Message bits plus flag bit
+        const unsigned int test = ((2u << bits) - 1);
+
+        for ( ; lo != hi; ++lo, data += stride)
+        {
+            const unsigned int cell = (*data & test);
+
+            // Check for terminating character
+            if (flag && cell == (1u << bits)) {
+                return lo;
+            }
+
+            for (int b = 0; b != bits; ++b)
+            {
+                const std::size_t k = (lo * bits) + b;
+                if ((k / 8) < size) {
+                    buff[k / 8] |= static_cast<char>(((cell >> b) & 1u) << (k % 8));
+                }
+            }
+        }
+
+        return npos;
+    }
+
+    /*! Helper
+     * True if both paths name the same file
+     */
+    bool same_file(const char* a, const char* b)
+    {
+        struct stat sa, sb;
+        return ::stat(a, &sa) == 0 && ::stat(b, &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+    }
+}
+
+/*! dtor.
+ */
+steg::tiled_image::~tiled_image() {  }
+
+/*! ctor.
+ */
+steg::tiled_image::tiled_image() : w_(0)
+                                 , h_(0)
+                                 , nchanns_(0)
+                                 , depth_(1)
+                                 , bottomUp_(false)
+                                 , layout_({ 1, false, false, false, 0 })
+                                 , ops_(nullptr)
+                                 , length_(0)
+                                 , checksum_(0)
+                                 , cipher_(cipher::CTR)
+                                 , mode_(-1)
+                                 , nonce_()
+                                 , recorded_()
+                                 , written_(false)
+                                 , pool_(nullptr)
+                                 , compression_({ compression::ZLIB, 6 }) {  }
+
+/*! Message size
+ */
+std::size_t steg::tiled_image::size() const
+{
+    // Known from the header
+    if (length_ != 0) {
+        return length_;
+    }
+
+    // Otherwise, every cell
+    return ((cells() * layout_.bits) + 7) / 8;
+}
+
+/*! Save file
+ */
+bool steg::tiled_image::save(const char* path, const image::image_type type) const
+{
+    // Just in case
+    if (!path) {
+        return ((error::get())->log("Error: invalid save path"), false);
+    }
+
+    // The source image is read while the output is written
+    if (same_file(path, path_.c_str())) {
+        return ((error::get())->log("Error: tiled mode cannot save over the source image ", path), false);
+    }
+
+    // A message spread over all channels only stays put if they do
+    if (layout_.allChanns && !image::keeps_channels(type, nchanns_)) {
+        return ((error::get())->log("Error: BMP and QOI images store grey pixels as RGB, which moves a message spread over all channels (-a); "
+                                    "use PNG, TGA, PNM or PAM, unable to save image ", path), false);
+    }
+
+    std::unique_ptr<raster_reader> owner;
+    raster_reader* const reader = source(owner);
+    if (!reader) {
+        return false;
+    }
+
+    // Regions to embed, and the region to stamp terminators over
+    region regions[2];
+    std::size_t nregions = 0;
+    region tail = { 0, 0, nullptr, nullptr, 0, true };
+
+    char header[header_size];
+
+    if (written_)
+    {
+        const std::size_t ncells = message_cells(message_.size());
+
+        if (layout_.terminated)
+        {
+            regions[nregions++] = { 0, ncells, message_.data(), nullptr, message_.size(), true };
+            tail = { ncells, cells() - ncells, nullptr, nullptr, 0, true };
+        }
+
+        else
+        {
+            header_store(header, length_, checksum_, cipher_, nonce_);
+            regions[nregions++] = { 0, message_cells(header_size), header, nullptr, header_size, false };
+            regions[nregions++] = { message_cells(header_size), ncells, message_.data(), nullptr, message_.size(), false };
+        }
+    }
+
+    // Pixels stored as-is only change where the message goes; stdout cannot be patched
+    raster_map map;
+    if (reader->map(map) && map.type == type && ::strcmp(path, "-") != 0)
+    {
+        owner.reset();
+        return patch(path, map, regions, nregions, tail);
+    }
+
+    // Only BMP and TGA rows can go bottom row first; for every other type, bottom-up images are read backwards
+    const bool inOrder = (type != image::BMP && type != image::TGA);
+
+    // stb cannot stream
+    const compression comp = (compression_.method == compression::STB) ? compression({ compression::ZLIB, 6 }) : compression_;
+
+    std::unique_ptr<raster_writer> writer(raster_writer::create(path, type, w_, h_, nchanns_, depth_, bottomUp_ && !inOrder, comp));
+    if (!writer) {
+        return false;
+    }
+
+    writer->set_pool(pool_);
+
+    const std::size_t rowSize = static_cast<std::size_t>(w_) * nchanns_ * depth_;
+    bool ret = true;
+
+    // Every row goes through
+    if (!scan(*reader, 0, h_, inOrder, [&](unsigned char* band, const int r, const int step, const int n) {
+
+            run(n, [&](const std::size_t j) {
+                unsigned char* const row = band + (j * rowSize);
+                const std::size_t c0 = row_cell(r + (step * static_cast<int>(j)));
+
+                for (std::size_t i = 0; i != nregions; ++i) {
+                    embed_row(row, c0, regions[i]);
+                }
+
+                terminate_row(row, c0, tail);
+            });
+
+            return (ret = writer->write(band, n));
+        }))
+    {
+        return ((error::get())->log("Error: unable to load image ", path_.c_str()), false);
+    }
+
+    if (!(ret && writer->close())) {
+        return ((error::get())->log("Error: unable to save image ", path), false);
+    }
+
+    return true;
+}
+
+/*! Patches a copy of the source image
+ */
+bool steg::tiled_image::patch(const char* path, const raster_map& map, const region* regions, const std::size_t nregions, const region& tail) const
+{
+    // Rows that carry a region
+    std::vector<char> touched(h_, 0);
+    auto touch = [&](const region& rg) {
+        if (rg.ncells != 0) {
+            std::fill(touched.begin() + (rg.first / row_cells()), touched.begin() + ((rg.first + rg.ncells - 1) / row_cells()) + 1, 1);
+        }
+    };
+
+    for (std::size_t i = 0; i != nregions; ++i) {
+        touch(regions[i]);
+    }
+    touch(tail);
+
+    std::vector<int> rows;
+    for (int r = 0; r != h_; ++r) {
+        if (touched[r]) {
+            rows.push_back(r);
+        }
+    }
+
+    mapped_file out;
+    if (!mapped_file::copy(path_.c_str(), path) || !out.open(path, true) ||
+        out.size() < static_cast<std::size_t>(map.offset) + (map.rowSize * h_)) {
+        return ((error::get())->log("Error: unable to save image ", path), false);
+    }
+
+    const std::size_t rowSize = static_cast<std::size_t>(w_) * nchanns_;
+
+    run(rows.size(), [&](const std::size_t j) {
+        const int r = rows[j];
+        unsigned char* const stored = out.data() + map.offset + (map.rowSize * (bottomUp_ ? (h_ - 1 - r) : r));
+
+        // Into the channel order the cells are laid out in, and back
+        std::vector<unsigned char> row(rowSize);
+        for (int x = 0; x != w_; ++x) {
+            for (int c = 0; c != nchanns_; ++c) {
+                row[(x * nchanns_) + c] = stored[(x * map.pixelSize) + map.order[c]];
+            }
+        }
+
+        const std::size_t c0 = row_cell(r);
+        for (std::size_t i = 0; i != nregions; ++i) {
+            embed_row(row.data(), c0, regions[i]);
+        }
+
+        terminate_row(row.data(), c0, tail);
+
+        for (int x = 0; x != w_; ++x) {
+            for (int c = 0; c != nchanns_; ++c) {
+                stored[(x * map.pixelSize) + map.order[c]] = row[(x * nchanns_) + c];
+            }
+        }
+    });
+
+    if (!out.close()) {
+        return ((error::get())->log("Error: unable to save image ", path), false);
+    }
+
+    return true;
+}
+
+/*! Streamable
+ */
+bool steg::tiled_image::readable(const char* path)
+{
+    return std::unique_ptr<raster_reader>(raster_reader::probe(path)) != nullptr;
+}
+
+/*! Open file
+ */
+std::size_t steg::tiled_image::open(const char* path, const layout& lay)
+{
+    // Return if image already opened
+    if (!path_.empty()) {
+        return 0;
+    }
+
+    if (lay.scattered) {
+        return ((error::get())->log("Error: tiled mode cannot scatter the message (-s)"), 0);
+    }
+
+    layout_ = lay;
+
+    // Only the dimensions for now
+    std::unique_ptr<raster_reader> reader(raster_reader::open(path));
+    if (!reader) {
+        return 0;
+    }
+
+    path_ = path;
+    w_ = reader->width();
+    h_ = reader->height();
+    nchanns_ = reader->channels();
+    depth_ = reader->depth();
+    bottomUp_ = reader->bottom_up();
+
+    if (layout_.bits > max_bits(layout_, depth_)) {
+        return ((error::get())->log("Error: bits per channel must be between 1 and 4 for 8-bit images, and 1 and 8 for 16-bit ones (7 with --legacy) (use -n), exiting"), 0);
+    }
+
+    // Resolve the kernels for this layout
+    ops_ = &lsb_select(stride(), layout_.bits);
+
+    // stdin can only be read once; the reader is kept, and goes back over the rows it holds
+    if (path_ == "-") {
+        stream_ = std::move(reader);
+    }
+
+    reader.reset();
+
+    // Look for a message header
+    if (!probe()) {
+        return ((error::get())->log("Error: unable to load image ", path), 0);
+    }
+
+    return (static_cast<std::size_t>(w_) * h_ * nchanns_ * depth_);
+}
+
+/*! Reads message from image
+ */
+std::size_t steg::tiled_image::read(char* buff, const std::size_t buffSize)
+{
+    // No. of cells
+    const std::size_t size = cells();
+    const std::size_t cpr = row_cells();
+
+    std::size_t n;
+
+    // Message follows a header, only read the rows it occupies
+    if (length_ != 0)
+    {
+        // Just in case
+        // Ensure that buffer is large enough
+        if (buffSize < length_) {
+            return ((error::get())->log("Error: output buffer is too small to accomodate message size, exiting"), 0);
+        }
+
+        const region rg = { message_cells((mode_ != -1) ? header_size : header_v1_size), message_cells(length_), nullptr, buff, length_, false };
+        ::memset(buff, 0, length_);
+
+        std::size_t t;
+        if (!extract(rg, static_cast<int>(rg.first / cpr), static_cast<int>(((rg.first + rg.ncells - 1) / cpr) + 1), t)) {
+            return ((error::get())->log("Error: unable to load image ", path_.c_str()), 0);
+        }
+
+        if (crc32c(0, buff, length_) != checksum_) {
+            return ((error::get())->log("Error: message checksum mismatch, image is corrupt, exiting"), 0);
+        }
+
+        n = length_;
+    }
+
+    // No header; only images encoded with --legacy end the message with a terminating character instead
+    else if (!layout_.terminated) {
+        return ((error::get())->log("Error: no message header in image; if it was encoded by an older version, decode it with --legacy -m ecb, exiting"), 0);
+    }
+
+    // Otherwise, message ends with a terminating character
+    else
+    {
+        // Just in case
+        // Ensure that buffer is large enough
+        if ((buffSize * 8) < (size * layout_.bits)) {
+            return ((error::get())->log("Error: output buffer is too small to accomodate message size, exiting"), 0);
+        }
+
+        const region rg = { 0, size, nullptr, buff, buffSize, true };
+        ::memset(buff, 0, buffSize);
+
+        // Unapply steganography
+        std::size_t t;
+        if (!extract(rg, 0, h_, t)) {
+            return ((error::get())->log("Error: unable to load image ", path_.c_str()), 0);
+        }
+
+        n = (t * layout_.bits) / 8;
+    }
+
+    // Terminate and return
+    if (n < buffSize) {
+        buff[n] = 0;
+    }
+
+    return n;
+}
+
+/*! Writes message to image
+ */
+std::size_t steg::tiled_image::write(const char* buff, const std::size_t buffSize)
+{
+    message_.clear();
+    return (append(buff, buffSize) == buffSize && finish()) ? buffSize : 0;
+}
+
+/*! Writes part of a message to image
+ */
+std::size_t steg::tiled_image::append(const char* buff, const std::size_t buffSize)
+{
+    // No. of cells
+    const std::size_t size = cells();
+
+    // No. of cells that carry the message, the last one may be partially used
+    const std::size_t ncells = message_cells(message_.size() + buffSize);
+
+    // Ensure that file size is large enough to hold image
+    // Message ends with a terminating character, or follows a header
+    if ((ncells + (layout_.terminated ? 0 : message_cells(header_size))) > size) {
+        return ((error::get())->log("Error: source image is too small to encode entire message, exiting"), 0);
+    }
+
+    message_.insert(message_.end(), buff, buff + buffSize);
+    return buffSize;
+}
+
+/*! Ends a message
+ */
+bool steg::tiled_image::finish()
+{
+    written_ = true;
+
+    if (!layout_.terminated)
+    {
+        length_ = message_.size();
+        checksum_ = crc32c(0, message_.data(), message_.size());
+    }
+
+    return true;
+}
+
+/*! Source image
+ */
+steg::raster_reader* steg::tiled_image::source(std::unique_ptr<raster_reader>& owner) const
+{
+    if (stream_)
+    {
+        if (!stream_->seek(0)) {
+            return ((error::get())->log("Error: unable to read the image on stdin again, the rows needed are no longer held"), nullptr);
+        }
+
+        return stream_.get();
+    }
+
+    owner.reset(raster_reader::open(path_.c_str()));
+    return owner.get();
+}
+
+/*! Runs tasks
+ */
+template <typename T>
+void steg::tiled_image::run(const std::size_t ntasks, const T& task) const
+{
+    if (pool_ == nullptr || ntasks < 2)
+    {
+        for (std::size_t i = 0; i != ntasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    pool_->run(ntasks, task);
+}
+
+/*! Scans rows
+ */
+template <typename T>
+bool steg::tiled_image::scan(raster_reader& reader, const int r0, const int r1, const bool inOrder, const T& fn) const
+{
+    const std::size_t rowSize = static_cast<std::size_t>(w_) * nchanns_ * depth_;
+    const int nrows = band_rows();
+
+    std::unique_ptr<unsigned char[]> band(new unsigned char[rowSize * std::min(nrows, r1 - r0)]);
+
+    // Bottom-up, in image order: bands are read from the end of the file, and flipped
+    if (bottomUp_ && inOrder)
+    {
+        for (int r = r0; r < r1; )
+        {
+            const int n = std::min(nrows, r1 - r);
+
+            if (!reader.seek(h_ - r - n) || !reader.read(band.get(), n)) {
+                return false;
+            }
+
+            for (int j = 0; j != (n / 2); ++j) {
+                std::swap_ranges(band.get() + (j * rowSize), band.get() + ((j + 1) * rowSize), band.get() + ((n - 1 - j) * rowSize));
+            }
+
+            if (!fn(band.get(), r, 1, n)) {
+                break;
+            }
+
+            r += n;
+        }
+
+        return true;
+    }
+
+    // Otherwise, in file order
+    const int f0 = bottomUp_ ? (h_ - r1) : r0;
+    const int f1 = bottomUp_ ? (h_ - r0) : r1;
+
+    if (!reader.skip(f0)) {
+        return false;
+    }
+
+    for (int f = f0; f < f1; )
+    {
+        const int n = std::min(nrows, f1 - f);
+
+        if (!reader.read(band.get(), n)) {
+            return false;
+        }
+
+        if (!fn(band.get(), bottomUp_ ? (h_ - 1 - f) : f, bottomUp_ ? -1 : 1, n)) {
+            break;
+        }
+
+        f += n;
+    }
+
+    return true;
+}
+
+/*! Extracts a region, one band at a time
+ */
+bool steg::tiled_image::extract(const region& rg, const int r0, const int r1, std::size_t& t) const
+{
+    std::unique_ptr<raster_reader> owner;
+    raster_reader* const reader = source(owner);
+    if (!reader) {
+        return false;
+    }
+
+    const std::size_t rowSize = static_cast<std::size_t>(w_) * nchanns_ * depth_;
+    std::unique_ptr<std::size_t[]> terms(new std::size_t[band_rows()]);
+
+    t = npos;
+
+    if (!scan(*reader, r0, r1, false, [&](unsigned char* band, const int r, const int step, const int n) {
+
+            // Whole bytes of each row in parallel, then the bytes rows share
+            run(n, [&](const std::size_t j) {
+                terms[j] = extract_row(band + (j * rowSize), row_cell(r + (step * static_cast<int>(j))), rg, false);
+            });
+
+            for (int j = 0; j != n; ++j) {
+                t = std::min({ t, terms[j], extract_row(band + (j * rowSize), row_cell(r + (step * j)), rg, true) });
+            }
+
+            // Rows come in image order, the first terminator is the one
+            return (t == npos || bottomUp_);
+        }))
+    {
+        return false;
+    }
+
+    if (t == npos) {
+        t = rg.ncells;
+    }
+
+    return true;
+}
+
+/*! Embeds a region over a row
+ */
+void steg::tiled_image::embed_row(unsigned char* row, const std::size_t c0, const region& rg) const
+{
+    std::size_t lo, hi;
+    if (!clip(c0, rg, lo, hi)) {
+        return;
+    }
+
+    const int s = stride();
+    const int bits = layout_.bits;
+    const auto at = [&](const std::size_t k) { return row + lsb_offset(depth_) + ((rg.first + k - c0) * s); };
+
+    // Bytes the row shares at either end go one bit at a time, the kernels take the rest
+    const std::size_t a = std::min(align(lo), hi);
+    const std::size_t m = a + ((hi - a) & ~static_cast<std::size_t>(7));
+
+    put(at(lo), s, bits, rg.flag, rg.in, rg.size, lo, a);
+
+    if (m != a) {
+        ops_->embed(at(a), s, bits, rg.flag, rg.in + ((a * bits) / 8), ((m - a) * bits) / 8);
+    }
+
+    put(at(m), s, bits, rg.flag, rg.in, rg.size, m, hi);
+}
+
+/*! Stamps terminators over a row
+ */
+void steg::tiled_image::terminate_row(unsigned char* row, const std::size_t c0, const region& rg) const
+{
+    std::size_t lo, hi;
+    if (clip(c0, rg, lo, hi)) {
+        ops_->terminate(row + lsb_offset(depth_) + ((rg.first + lo - c0) * stride()), stride(), layout_.bits, hi - lo);
+    }
+}
+
+/*! Extracts a region from a row
+ */
+std::size_t steg::tiled_image::extract_row(const unsigned char* row, const std::size_t c0, const region& rg, const bool edges) const
+{
+    std::size_t lo, hi;
+    if (!clip(c0, rg, lo, hi)) {
+        return npos;
+    }
+
+    const int s = stride();
+    const int bits = layout_.bits;
+    const auto at = [&](const std::size_t k) { return row + lsb_offset(depth_) + ((rg.first + k - c0) * s); };
+
+    const std::size_t a = std::min(align(lo), hi);
+    const std::size_t m = a + ((hi - a) & ~static_cast<std::size_t>(7));
+
+    if (edges)
+    {
+        const std::size_t t = get(at(lo), s, bits, rg.flag, rg.out, rg.size, lo, a);
+        return (t != npos) ? t : get(at(m), s, bits, rg.flag, rg.out, rg.size, m, hi);
+    }
+
+    if (m == a) {
+        return npos;
+    }
+
+    const std::size_t n = ops_->extract(at(a), s, bits, rg.flag, rg.out + ((a * bits) / 8), m - a);
+    return (n != (m - a)) ? (a + n) : npos;
+}
+
+/*! Cells of a region in a row
+ */
+bool steg::tiled_image::clip(const std::size_t c0, const region& rg, std::size_t& lo, std::size_t& hi) const
+{
+    const std::size_t first = std::max(c0, rg.first);
+    const std::size_t last = std::min(c0 + row_cells(), rg.first + rg.ncells);
+
+    if (first >= last) {
+        return false;
+    }
+
+    lo = first - rg.first;
+    hi = last - rg.first;
+
+    return true;
+}
+
+/*! No. of rows per band
+ */
+int steg::tiled_image::band_rows() const
+{
+    const std::size_t rows = band_size / (static_cast<std::size_t>(w_) * nchanns_ * depth_);
+    return static_cast<int>(std::min<std::size_t>(std::max<std::size_t>(rows, 1), h_));
+}
+
+/*! Looks for a message header
+ */
+bool steg::tiled_image::probe()
+{
+    length_ = 0;
+    checksum_ = 0;
+    mode_ = -1;
+
+    // No. of cells
+    const std::size_t size = cells();
+
+    if (message_cells(header_v1_size) > size) {
+        return true; // Too small
+    }
+
+    // As much of a header as fits; version 1 headers are shorter
+    const std::size_t fits = (message_cells(header_size) <= size) ? header_size : header_v1_size;
+
+    char header[header_size] = {  };
+    const region rg = { 0, message_cells(fits), nullptr, header, fits, false };
+
+    std::size_t t;
+    if (!extract(rg, 0, static_cast<int>(((rg.ncells - 1) / row_cells()) + 1), t)) {
+        return false;
+    }
+
+    std::uint64_t length;
+    std::uint32_t checksum;
+    int mode;
+    std::size_t hsize;
+
+    if (!header_load(header, length, checksum, mode, recorded_, hsize) || hsize > fits) {
+        return true; // No header
+    }
+
+    const std::size_t hcells = message_cells(hsize);
+
+    // Ensure the message fits in the image
+    if (length == 0 || length > (((size - hcells) * layout_.bits) / 8)) {
+        return true;
+    }
+
+    length_ = length;
+    checksum_ = checksum;
+    mode_ = mode;
+
+    return true;
+}
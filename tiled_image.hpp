@@ -0,0 +1,268 @@
+/* tiled_image.hpp -- v1.0 -- reads and writes a message to a source image one band of rows at a time
+   Author: Sam Y. 2021 */
+
+#ifndef _TILED_IMAGE_HPP
+#define _TILED_IMAGE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cipher.hpp"
+#include "cipher_ctl.hpp"
+#include "compression.hpp"
+#include "image.hpp"
+#include "layout.hpp"
+
+namespace steg {
+    // Fwd. decl.
+    struct lsb_ops;
+    class raster_reader;
+    struct raster_map;
+    class thread_pool;
+
+    /// @class tiled_image
+    /// Same interface and message layout as image, but the pixels are never held in memory
+    /// all at once: the source file is decoded, embedded into and re-encoded band by band,
+    /// so memory use is bounded by the band size instead of the image size
+    class tiled_image {
+    public:
+
+        /// dtor.
+        ~tiled_image();
+
+        /// ctor.
+        tiled_image();
+
+        /// Spreads embedding and extraction over a pool of threads
+        /// @param pool    worker threads, or nullptr to run on the calling thread only
+        inline void set_pool(thread_pool* pool) {
+            pool_ = pool;
+        }
+
+        /// Picks how PNG images are compressed on save; stb cannot stream, zlib's default level is used instead
+        /// @param comp    deflate implementation and level
+        inline void set_compression(const compression& comp) {
+            compression_ = comp;
+        }
+
+        /// Picks the cipher mode and nonce recorded in the header on save
+        /// @param mode     cipher mode the message was encrypted with
+        /// @param nonce    message nonce, cipher_nonce_size bytes
+        inline void set_cipher(const cipher::mode_type mode, const char* nonce) {
+            cipher_ = mode;
+            ::memcpy(nonce_, nonce, sizeof(nonce_));
+        }
+
+        /// @return    the cipher mode recorded in the header, a cipher::mode_type; -1 if the image has no header, or one that does not record it
+        inline int cipher_mode() const {
+            return mode_;
+        }
+
+        /// @return    the nonce recorded in the header, cipher_nonce_size bytes; nullptr if the image has no header, or one that does not record it
+        inline const char* cipher_nonce() const {
+            return (mode_ != -1) ? recorded_ : nullptr;
+        }
+
+        /// @return    the size of the message, or an upper bound if the image has no header
+        std::size_t size() const;
+
+        /// Saves file; re-reads the source image, and embeds the message on the way out.
+        /// BMP and TGA sources that store pixels as-is, saved as the same type, are copied
+        /// instead, and only the rows that carry the message are patched
+        /// @param path    output image path, must differ from the source image
+        /// @param type    output image file type
+        /// @return        true on success, false otherwise
+        bool save(const char* path, const image::image_type type) const;
+
+        /// Tells whether an image can be read a band of rows at a time, without logging errors
+        /// @param path    path/to/image/file
+        /// @return        true for non-interlaced PNG, and BMP, TGA, QOI, PNM and PAM images the readers take
+        static bool readable(const char* path);
+
+        /// Opens file, only reads the header
+        /// @param path    path/to/image/file; a non-interlaced PNG, or a BMP, TGA, QOI, PNM or PAM
+        ///                image; or "-" for a PNM or PAM image on stdin, which is read only once
+        /// @param lay     how the message is laid out over the pixels; cannot be scattered
+        /// @return        image size
+        std::size_t open(const char* path, const layout& lay);
+
+        /// Reads message from image
+        /// @param buff[out]    unallocated output buffer
+        /// @param buffSize     size of buff
+        /// @return             number of bytes read
+        std::size_t read(char* buff, const std::size_t buffSize);
+
+        /// Writes message to image; the message is embedded by save()
+        /// @param buff        input message [in]
+        /// @param buffSize    input message size [in]
+        /// @return            number of bytes written
+        std::size_t write(const char* buff, const std::size_t buffSize);
+
+        /// Writes the next part of a message to image, for messages written a chunk at a time; finish() ends the message.
+        /// Parts are kept until save(), as the header that precedes the message needs its size and checksum
+        /// @param buff        next part of the message [in]
+        /// @param buffSize    its size
+        /// @return            number of bytes written, 0 if the message no longer fits
+        std::size_t append(const char* buff, const std::size_t buffSize);
+
+        /// Ends a message written with append()
+        /// @return    true on success, false otherwise
+        bool finish();
+
+    private:
+
+        /*! @class: a run of cells that carries (part of) a message
+         */
+        struct region {
+            std::size_t first;  // > first cell
+            std::size_t ncells; // > no. of cells
+            const char* in;     // > message to embed, or nullptr
+            char* out;          // > extracted message, zeroed beforehand; or nullptr
+            std::size_t size;   // > size of in or out, in bytes
+            bool flag;          // > terminated layout
+        };
+
+        /*! Looks for a message header, sets length_ and checksum_
+         */
+        bool probe();
+
+        /*! Opens the source image at its first row; stdin is not reopened, but rewound to it
+         * @param owner    takes the reader if it was opened [out]
+         * @return         the reader, or nullptr on failure
+         */
+        raster_reader* source(std::unique_ptr<raster_reader>& owner) const;
+
+        /*! Copies the source image to path, then embeds regions, and stamps terminators
+         * over tail, in the rows of the copy they fall in
+         */
+        bool patch(const char* path, const raster_map& map, const region* regions, const std::size_t nregions, const region& tail) const;
+
+        /*! Calls fn(band, r, step, n) over image rows [r0, r1), n rows at a time, where
+         * band row j holds image row (r + step * j). Rows come in file order, or in image
+         * order (top row first) if inOrder is set. Stops early if fn returns false
+         * @return    false if the image could not be read
+         */
+        template <typename T>
+        bool scan(raster_reader& reader, const int r0, const int r1, const bool inOrder, const T& fn) const;
+
+        /*! Runs task(i) for every i in [0, ntasks), across the pool if there is one
+         */
+        template <typename T>
+        void run(const std::size_t ntasks, const T& task) const;
+
+        /*! Extracts a region from image rows [r0, r1)
+         * @param t    no. of cells before the terminator, or the size of the region if there is none [out]
+         * @return     false if the image could not be read
+         */
+        bool extract(const region& rg, const int r0, const int r1, std::size_t& t) const;
+
+        /*! Embeds the cells of a region that fall in a row; c0 is the row's first cell
+         */
+        void embed_row(unsigned char* row, const std::size_t c0, const region& rg) const;
+
+        /*! Stamps the terminating character over the cells of a region that fall in a row
+         */
+        void terminate_row(unsigned char* row, const std::size_t c0, const region& rg) const;
+
+        /*! Extracts the cells of a region that fall in a row; either the whole bytes
+         * in its middle, or the bytes it shares with the rows around it (edges)
+         * @return    the first cell of the terminator, relative to the region; npos if there is none
+         */
+        std::size_t extract_row(const unsigned char* row, const std::size_t c0, const region& rg, const bool edges) const;
+
+        /*! Helper
+         * Cells of a region that fall in a row, relative to the region
+         */
+        bool clip(const std::size_t c0, const region& rg, std::size_t& lo, std::size_t& hi) const;
+
+        /*! Helper
+         * First cell of an image row
+         */
+        inline std::size_t row_cell(const int r) const {
+            return static_cast<std::size_t>(r) * row_cells();
+        }
+
+        /*! Helper
+         * No. of rows per band
+         */
+        int band_rows() const;
+
+        /*! Helper
+         * No. of cells per row
+         */
+        inline std::size_t row_cells() const {
+            return static_cast<std::size_t>(w_) * (layout_.allChanns ? nchanns_ : 1);
+        }
+
+        /*! Helper
+         * No. of cells that can carry the message
+         */
+        inline std::size_t cells() const {
+            return row_cells() * h_;
+        }
+
+        /*! Helper
+         * No. of cells taken up by a message of the given size; the last one may be partially used
+         */
+        inline std::size_t message_cells(const std::size_t size) const {
+            return ((size * 8) + layout_.bits - 1) / layout_.bits;
+        }
+
+        /*! Helper
+         * Distance between cells, in bytes
+         */
+        inline int stride() const {
+            return (layout_.allChanns ? 1 : nchanns_) * depth_;
+        }
+
+        // Non-copyable
+        explicit tiled_image(tiled_image&) = delete;
+        explicit tiled_image(const tiled_image&) = delete;
+
+        // Source image; and its reader, if it comes from stdin
+        std::string path_;
+        std::unique_ptr<raster_reader> stream_;
+
+        // Image width, height, no. of channels
+        int w_, h_, nchanns_;
+
+        // Bytes per sample; 16-bit samples are in host byte order
+        int depth_;
+
+        // Row order of the source image
+        bool bottomUp_;
+
+        // Message layout
+        layout layout_;
+
+        // Kernels for the message layout
+        const lsb_ops* ops_;
+
+        // Message size and checksum, from the header; 0 if the image has none
+        std::size_t length_;
+        std::uint32_t checksum_;
+
+        // Cipher mode to record in the header, and the one recorded in it; -1 if none
+        cipher::mode_type cipher_;
+        int mode_;
+
+        // Nonce to record in the header, and the one recorded in it, if mode_ is not -1
+        char nonce_[cipher_nonce_size];
+        char recorded_[cipher_nonce_size];
+
+        // Message passed to write() or append(), held whole until save() embeds it
+        std::vector<char> message_;
+        bool written_;
+
+        // Worker threads, not owned; nullptr if single-threaded
+        thread_pool* pool_;
+
+        // PNG compression
+        compression compression_;
+    };
+}
+
+#endif